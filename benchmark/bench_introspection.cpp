@@ -0,0 +1,162 @@
+/***************************************************************************
+* Copyright (c) 2023, QuantStack
+*
+* Distributed under the terms of the GNU General Public License v3.
+*
+* The full license is in the file LICENSE, distributed with this software.
+****************************************************************************/
+
+// Latency of complete, inspect and is_complete in a synthetic session:
+//
+//   bench_introspection [--packages 20] [--package-names 1000] [--objects 5000]
+//                       [--cell-lines 2000] [--requests 200]
+//
+// attaches `packages` generated environments of `package-names` names each,
+// locked like package environments, defines `objects` globals and a long
+// cell, then prints {n, p50_ms, p99_ms, mean_ms} for each request, as json.
+// The session does not depend on the installed packages, so results compare
+// across machines. The interpreter runs in-process, without zmq.
+
+#include <iostream>
+#include <memory>
+#include <string>
+
+#include "xeus/xeus_context.hpp"
+#include "xeus/xkernel.hpp"
+
+#include "xeus-r/xinterpreter.hpp"
+
+#include "bench_utils.hpp"
+#include "memory_server.hpp"
+
+namespace bench = xeus_r::bench;
+
+namespace {
+
+    void setup_session(int packages, int package_names, int objects) {
+        bench::r_run(
+            "for (i in seq_len(" + std::to_string(packages) + ")) local({\n"
+            "  env <- attach(NULL, name = sprintf('package:synthetic%02d', i), warn.conflicts = FALSE)\n"
+            "  for (j in seq_len(" + std::to_string(package_names) + ")) {\n"
+            "    assign(sprintf('pkg%02d_function_%05d', i, j), function(x, ...) NULL, envir = env)\n"
+            "  }\n"
+            "  lockEnvironment(env, bindings = TRUE)\n"
+            "})"
+        );
+        bench::r_run(
+            "for (i in seq_len(" + std::to_string(objects) + ")) assign(sprintf('object_%06d', i), i, envir = globalenv())\n"
+            "big_list <- stats::setNames(as.list(seq_len(1000)), sprintf('name_%04d', seq_len(1000)))"
+        );
+    }
+
+    std::string long_cell(int lines) {
+        std::string cell;
+        for (int i = 0; i < lines; i++) {
+            std::string n = std::to_string(i);
+            cell += "x_" + n + " <- paste(object_000001, \"value " + n + "\", sep = '-') # line " + n + "\n";
+        }
+        return cell;
+    }
+
+    // requests sent while typing at the end of a long cell: each one
+    // has one more character than the previous one
+    std::string typed(const std::string& cell, const std::string& text, int i) {
+        std::string code = cell + text;
+        code.append(static_cast<std::size_t>(i % 50), 'a');
+        return code;
+    }
+
+    nl::json run(xeus_r::interpreter& interpreter, int requests, int lines) {
+        auto complete = [&](const std::string& code) {
+            return bench::summarize(bench::measure(requests, [&](int) {
+                interpreter.complete_request(code, static_cast<int>(code.size()));
+            }));
+        };
+        auto inspect = [&](const std::string& code, int detail_level) {
+            return bench::summarize(bench::measure(requests, [&](int) {
+                interpreter.inspect_request(code, static_cast<int>(code.size()), detail_level);
+            }));
+        };
+        auto is_complete = [&](const std::string& code) {
+            return bench::summarize(bench::measure(requests, [&](int) {
+                interpreter.is_complete_request(code);
+            }));
+        };
+
+        std::string cell = long_cell(lines);
+
+        nl::json result;
+        result["complete"] = {
+            {"prefix", complete("obj")},
+            {"prefix_many", complete("object_00")},
+            {"fuzzy", complete("objct12")},
+            {"member", complete("big_list$name_00")},
+            {"arguments", complete("rnorm(me")},
+            {"path", complete("read.csv(\"")},
+            {"typing_long_cell", bench::summarize(bench::measure(requests, [&](int i) {
+                std::string code = typed(cell, "obj", i);
+                interpreter.complete_request(code, static_cast<int>(code.size()));
+            }))}
+        };
+        result["inspect"] = {
+            {"function_summary", inspect("rnorm", 0)},
+            {"function_full", inspect("rnorm", 1)},
+            {"object", inspect("object_000001", 0)},
+            {"call_long_cell", inspect(cell + "rnorm(1, ", 0)}
+        };
+        result["is_complete"] = {
+            {"complete_long_cell", is_complete(cell)},
+            {"incomplete_long_cell", is_complete(cell + "f(")},
+            {"typing_long_cell", bench::summarize(bench::measure(requests, [&](int i) {
+                interpreter.is_complete_request(typed(cell, "y <- ", i));
+            }))}
+        };
+        return result;
+    }
+
+}
+
+int main(int argc, char* argv[])
+{
+    if (std::getenv("R_HOME") == nullptr) {
+        std::cerr << "R_HOME must be set, e.g. R_HOME=$(R RHOME)" << std::endl;
+        return 1;
+    }
+
+    int packages = bench::int_option(argc, argv, "--packages", 20);
+    int package_names = bench::int_option(argc, argv, "--package-names", 1000);
+    int objects = bench::int_option(argc, argv, "--objects", 5000);
+    int lines = bench::int_option(argc, argv, "--cell-lines", 2000);
+    int requests = bench::int_option(argc, argv, "--requests", 200);
+
+    auto r_argv = bench::r_arguments(argv[0]);
+    auto interpreter = std::make_unique<xeus_r::interpreter>(static_cast<int>(r_argv.size()), r_argv.data());
+    xeus_r::interpreter& r = *interpreter;
+
+    int status = 0;
+    auto benchmark = [&](bench::memory_server&) {
+        try {
+            setup_session(packages, package_names, objects);
+            nl::json result = run(r, requests, lines);
+            result["session"] = {
+                {"search_path", bench::r_int("length(search())")},
+                {"package_names", package_names},
+                {"objects", objects},
+                {"cell_lines", lines},
+                {"requests", requests}
+            };
+            std::cout << result.dump(2) << std::endl;
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << std::endl;
+            status = 1;
+        }
+    };
+
+    xeus::xkernel kernel(xeus::get_user_name(),
+                         xeus::make_empty_context(),
+                         std::move(interpreter),
+                         bench::make_memory_server_builder(benchmark));
+    kernel.start();
+
+    return status;
+}
@@ -0,0 +1,143 @@
+/***************************************************************************
+* Copyright (c) 2023, QuantStack
+*
+* Distributed under the terms of the GNU General Public License v3.
+*
+* The full license is in the file LICENSE, distributed with this software.
+****************************************************************************/
+
+#ifndef XEUS_R_BENCH_UTILS_HPP
+#define XEUS_R_BENCH_UTILS_HPP
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#define R_NO_REMAP
+
+#include "R.h"
+#include "Rinternals.h"
+#include "R_ext/Parse.h"
+
+#include "nlohmann/json.hpp"
+
+namespace nl = nlohmann;
+
+namespace xeus_r {
+namespace bench {
+
+// same summary as the python benchmarks in test/
+inline nl::json summarize(std::vector<double> seconds) {
+    if (seconds.empty()) {
+        return {{"n", 0}};
+    }
+    std::sort(seconds.begin(), seconds.end());
+    auto percentile = [&](double q) {
+        return seconds[std::min(seconds.size() - 1, static_cast<std::size_t>(q * seconds.size()))] * 1000;
+    };
+    return {
+        {"n", seconds.size()},
+        {"p50_ms", percentile(0.50)},
+        {"p99_ms", percentile(0.99)},
+        {"mean_ms", std::accumulate(seconds.begin(), seconds.end(), 0.0) / seconds.size() * 1000}
+    };
+}
+
+// latencies of `n` calls of `f(i)`, after a few warm up calls
+template <typename F>
+std::vector<double> measure(int n, F f) {
+    for (int i = 0; i < 3; i++) {
+        f(i);
+    }
+
+    std::vector<double> seconds;
+    seconds.reserve(n);
+    for (int i = 0; i < n; i++) {
+        auto start = std::chrono::steady_clock::now();
+        f(i);
+        seconds.push_back(std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+    return seconds;
+}
+
+// resident set size, 0 when not known
+inline long rss_kb() {
+    long pages = 0, resident = 0;
+    std::ifstream statm("/proc/self/statm");
+    if (statm >> pages >> resident) {
+        return resident * (sysconf(_SC_PAGESIZE) / 1024);
+    }
+    return 0;
+}
+
+inline long peak_rss_kb() {
+    struct rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+#ifdef __APPLE__
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
+}
+
+// runs R code at top level, to set the session up
+inline void r_run(const std::string& code) {
+    SEXP code_ = PROTECT(Rf_mkString(code.c_str()));
+    ParseStatus status;
+    SEXP exprs = PROTECT(R_ParseVector(code_, -1, &status, R_NilValue));
+    if (status != PARSE_OK) {
+        UNPROTECT(2);
+        throw std::runtime_error("could not parse: " + code);
+    }
+    for (R_xlen_t i = 0; i < XLENGTH(exprs); i++) {
+        int error = 0;
+        R_tryEval(VECTOR_ELT(exprs, i), R_GlobalEnv, &error);
+        if (error) {
+            UNPROTECT(2);
+            throw std::runtime_error("error in: " + code);
+        }
+    }
+    UNPROTECT(2);
+}
+
+inline int r_int(const std::string& code) {
+    SEXP code_ = PROTECT(Rf_mkString(code.c_str()));
+    ParseStatus status;
+    SEXP exprs = PROTECT(R_ParseVector(code_, -1, &status, R_NilValue));
+    int error = 0;
+    SEXP value = status == PARSE_OK ? R_tryEval(VECTOR_ELT(exprs, 0), R_GlobalEnv, &error) : R_NilValue;
+    int out = (status == PARSE_OK && !error) ? Rf_asInteger(value) : NA_INTEGER;
+    UNPROTECT(2);
+    return out;
+}
+
+// --name value command line options
+inline int int_option(int argc, char* argv[], const std::string& name, int fallback) {
+    for (int i = 1; i + 1 < argc; i++) {
+        if (name == argv[i]) {
+            return std::atoi(argv[i + 1]);
+        }
+    }
+    return fallback;
+}
+
+// the embedded R is not given the benchmark options
+inline std::vector<char*> r_arguments(char* program) {
+    static char no_save[] = "--no-save";
+    static char no_restore[] = "--no-restore";
+    static char quiet[] = "--quiet";
+    return {program, no_save, no_restore, quiet};
+}
+
+}
+}
+
+#endif
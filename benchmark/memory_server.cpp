@@ -0,0 +1,94 @@
+/***************************************************************************
+* Copyright (c) 2023, QuantStack
+*
+* Distributed under the terms of the GNU General Public License v3.
+*
+* The full license is in the file LICENSE, distributed with this software.
+****************************************************************************/
+
+#include <memory>
+#include <utility>
+
+#include "xeus/xguid.hpp"
+
+#include "memory_server.hpp"
+
+namespace xeus_r {
+namespace bench {
+
+memory_server::memory_server(runner run)
+    : m_run(std::move(run))
+    , m_session(xeus::new_xguid())
+{}
+
+xeus::xmessage memory_server::request(const std::string& msg_type, nl::json content) {
+    nl::json header = {
+        {"msg_id", xeus::new_xguid()},
+        {"username", "bench"},
+        {"session", m_session},
+        {"date", xeus::iso8601_now()},
+        {"msg_type", msg_type},
+        {"version", xeus::get_protocol_version()}
+    };
+    return dispatch(xeus::channel::SHELL, xeus::xmessage(
+        {m_session}, std::move(header), nl::json::object(), nl::json::object(), std::move(content), {}
+    ));
+}
+
+xeus::xmessage memory_server::dispatch(xeus::channel c, xeus::xmessage message) {
+    m_reply = xeus::xmessage();
+    if (c == xeus::channel::CONTROL) {
+        notify_control_listener(std::move(message));
+    } else {
+        notify_shell_listener(std::move(message));
+    }
+    return std::move(m_reply);
+}
+
+void memory_server::queue_input_reply(xeus::xmessage message) {
+    m_input_replies.push_back(std::move(message));
+}
+
+std::size_t memory_server::published_count() const {
+    return m_published;
+}
+
+void memory_server::send_shell_impl(xeus::xmessage message) {
+    m_reply = std::move(message);
+}
+
+void memory_server::send_control_impl(xeus::xmessage message) {
+    m_reply = std::move(message);
+}
+
+void memory_server::send_stdin_impl(xeus::xmessage /*message*/) {
+    // like the zmq server, wait for the input reply before returning
+    if (!m_input_replies.empty()) {
+        xeus::xmessage reply = std::move(m_input_replies.front());
+        m_input_replies.pop_front();
+        notify_stdin_listener(std::move(reply));
+    }
+}
+
+void memory_server::publish_impl(xeus::xpub_message /*message*/, xeus::channel /*c*/) {
+    m_published++;
+}
+
+void memory_server::start_impl(xeus::xpub_message /*message*/) {
+    m_run(*this);
+}
+
+void memory_server::abort_queue_impl(const listener& /*l*/, long /*polling_interval*/) {}
+
+void memory_server::stop_impl() {}
+
+void memory_server::update_config_impl(xeus::xconfiguration& /*config*/) const {}
+
+xeus::xkernel::server_builder make_memory_server_builder(memory_server::runner run) {
+    return [run](xeus::xcontext&, const xeus::xconfiguration&, nl::json::error_handler_t) {
+        return std::make_unique<memory_server>(run);
+    };
+}
+
+}
+}
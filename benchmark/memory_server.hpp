@@ -0,0 +1,70 @@
+/***************************************************************************
+* Copyright (c) 2023, QuantStack
+*
+* Distributed under the terms of the GNU General Public License v3.
+*
+* The full license is in the file LICENSE, distributed with this software.
+****************************************************************************/
+
+#ifndef XEUS_R_BENCH_MEMORY_SERVER_HPP
+#define XEUS_R_BENCH_MEMORY_SERVER_HPP
+
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <string>
+
+#include "xeus/xkernel.hpp"
+#include "xeus/xserver.hpp"
+
+namespace xeus_r {
+namespace bench {
+
+// xeus server that stays in the process, instead of zmq sockets, so that
+// the kernel can be benchmarked without a frontend. Starting the kernel
+// runs `run`, the benchmark, then returns. Published messages are counted
+// and dropped.
+//
+// request() plays the frontend: the message is dispatched by the kernel
+// right away, on this thread, and the reply is returned. Input requests of
+// the kernel are answered with the replies queued by queue_input_reply().
+class memory_server : public xeus::xserver {
+public:
+
+    using runner = std::function<void(memory_server&)>;
+
+    explicit memory_server(runner run);
+
+    xeus::xmessage request(const std::string& msg_type, nl::json content);
+
+    // dispatches a message of the shell or control channel
+    xeus::xmessage dispatch(xeus::channel c, xeus::xmessage message);
+
+    void queue_input_reply(xeus::xmessage message);
+
+    std::size_t published_count() const;
+
+private:
+
+    void send_shell_impl(xeus::xmessage message) override;
+    void send_control_impl(xeus::xmessage message) override;
+    void send_stdin_impl(xeus::xmessage message) override;
+    void publish_impl(xeus::xpub_message message, xeus::channel c) override;
+    void start_impl(xeus::xpub_message message) override;
+    void abort_queue_impl(const listener& l, long polling_interval) override;
+    void stop_impl() override;
+    void update_config_impl(xeus::xconfiguration& config) const override;
+
+    runner m_run;
+    std::string m_session;
+    xeus::xmessage m_reply;
+    std::deque<xeus::xmessage> m_input_replies;
+    std::size_t m_published = 0;
+};
+
+xeus::xkernel::server_builder make_memory_server_builder(memory_server::runner run);
+
+}
+}
+
+#endif
@@ -0,0 +1,288 @@
+/***************************************************************************
+* Copyright (c) 2023, QuantStack
+*
+* Distributed under the terms of the GNU General Public License v3.
+*
+* The full license is in the file LICENSE, distributed with this software.
+****************************************************************************/
+
+// Replays scripted sequences of shell messages against the interpreter,
+// in-process, and reports for each scenario the throughput, and for each
+// message type the latencies, with a histogram, and the allocations:
+//
+//   xr-bench [--repeat 1] [scenario.json ...]
+//
+// without arguments, the scenarios of benchmark/scenarios/ are replayed.
+// A scenario is
+//
+//   {
+//     "name": "...",
+//     "setup": [ steps, not measured ],
+//     "steps": [ {"msg_type": "complete_request", "content": {...}, "repeat": 100}, ... ]
+//   }
+//
+// "{i}" in the strings of the content is replaced by the repetition number.
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "xeus/xeus_context.hpp"
+#include "xeus/xkernel.hpp"
+
+#include "xeus-r/xinterpreter.hpp"
+
+#include "bench_utils.hpp"
+#include "memory_server.hpp"
+
+namespace bench = xeus_r::bench;
+
+// C++ allocations of the whole process, xeus and xeus-r included. R's own
+// heap is not counted, its growth shows in the RSS.
+namespace {
+    std::atomic<std::size_t> allocation_count(0);
+    std::atomic<std::size_t> allocation_bytes(0);
+}
+
+void* operator new(std::size_t size) {
+    allocation_count.fetch_add(1, std::memory_order_relaxed);
+    allocation_bytes.fetch_add(size, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) {
+        return p;
+    }
+    throw std::bad_alloc();
+}
+
+void* operator new[](std::size_t size) {
+    return operator new(size);
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+void operator delete[](void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+namespace {
+
+    const nl::json default_execute_content = {
+        {"code", ""},
+        {"silent", false},
+        {"store_history", true},
+        {"user_expressions", nl::json::object()},
+        {"allow_stdin", false},
+        {"stop_on_error", true}
+    };
+
+    nl::json substitute(const nl::json& content, int i) {
+        if (content.is_string()) {
+            std::string s = content.get<std::string>();
+            for (auto pos = s.find("{i}"); pos != std::string::npos; pos = s.find("{i}", pos)) {
+                s.replace(pos, 3, std::to_string(i));
+            }
+            return s;
+        }
+        if (content.is_structured()) {
+            nl::json out = content;
+            for (auto& item: out.items()) {
+                item.value() = substitute(item.value(), i);
+            }
+            return out;
+        }
+        return content;
+    }
+
+    nl::json message_content(const nl::json& step, int i) {
+        std::string msg_type = step.at("msg_type");
+        nl::json content = substitute(step.value("content", nl::json::object()), i);
+        if (msg_type == "execute_request") {
+            nl::json full = default_execute_content;
+            full.update(content);
+            return full;
+        }
+        return content;
+    }
+
+    // latencies in power of 2 buckets of microseconds
+    nl::json histogram(const std::vector<double>& seconds) {
+        std::map<long, int> buckets;
+        for (double s: seconds) {
+            long bound = 1;
+            while (bound < s * 1e6) {
+                bound *= 2;
+            }
+            buckets[bound]++;
+        }
+        nl::json le_us = nl::json::array();
+        nl::json counts = nl::json::array();
+        for (auto& [bound, count]: buckets) {
+            le_us.push_back(bound);
+            counts.push_back(count);
+        }
+        return {{"le_us", le_us}, {"counts", counts}};
+    }
+
+    struct message_stats {
+        std::vector<double> seconds;
+        std::size_t allocations = 0;
+        std::size_t allocated_bytes = 0;
+        std::size_t published = 0;
+        int errors = 0;
+    };
+
+    class scenario_runner {
+    public:
+
+        explicit scenario_runner(bench::memory_server& server)
+            : m_server(server)
+        {}
+
+        void setup(const nl::json& steps) {
+            for (auto& step: steps) {
+                for (int i = 0; i < step.value("repeat", 1); i++) {
+                    m_server.request(step.at("msg_type"), message_content(step, i));
+                }
+            }
+        }
+
+        nl::json run(const nl::json& steps, int repeat) {
+            std::map<std::string, message_stats> stats;
+            std::size_t messages = 0;
+            double total = 0;
+
+            for (int r = 0; r < repeat; r++) {
+                for (auto& step: steps) {
+                    std::string msg_type = step.at("msg_type");
+                    auto& s = stats[msg_type];
+                    for (int i = 0; i < step.value("repeat", 1); i++) {
+                        nl::json content = message_content(step, i);
+
+                        std::size_t count = allocation_count.load();
+                        std::size_t bytes = allocation_bytes.load();
+                        std::size_t published = m_server.published_count();
+                        auto start = std::chrono::steady_clock::now();
+
+                        auto reply = m_server.request(msg_type, std::move(content));
+
+                        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+                        s.seconds.push_back(elapsed);
+                        s.allocations += allocation_count.load() - count;
+                        s.allocated_bytes += allocation_bytes.load() - bytes;
+                        s.published += m_server.published_count() - published;
+                        if (reply.content().is_object() && reply.content().value("status", "ok") == "error") {
+                            s.errors++;
+                        }
+                        messages++;
+                        total += elapsed;
+                    }
+                }
+            }
+
+            nl::json per_type;
+            for (auto& [msg_type, s]: stats) {
+                double n = static_cast<double>(s.seconds.size());
+                nl::json entry = bench::summarize(s.seconds);
+                entry["histogram"] = histogram(s.seconds);
+                entry["allocations_per_message"] = s.allocations / n;
+                entry["allocated_bytes_per_message"] = s.allocated_bytes / n;
+                entry["published_per_message"] = s.published / n;
+                entry["errors"] = s.errors;
+                per_type[msg_type] = std::move(entry);
+            }
+
+            return {
+                {"messages", messages},
+                {"seconds", total},
+                {"messages_per_second", total > 0 ? messages / total : 0},
+                {"requests", per_type},
+                {"rss_kb", bench::rss_kb()},
+                {"peak_rss_kb", bench::peak_rss_kb()}
+            };
+        }
+
+    private:
+
+        bench::memory_server& m_server;
+    };
+
+    std::vector<std::string> scenario_files(int argc, char* argv[]) {
+        std::vector<std::string> files;
+        for (int i = 1; i < argc; i++) {
+            std::string arg = argv[i];
+            if (arg.rfind("--", 0) == 0) {
+                i++;
+            } else {
+                files.push_back(arg);
+            }
+        }
+        if (files.empty()) {
+            for (auto name: {"execute", "introspection", "comm", "display"}) {
+                files.push_back(std::string(XEUS_R_BENCH_SCENARIOS) + "/" + name + ".json");
+            }
+        }
+        return files;
+    }
+
+}
+
+int main(int argc, char* argv[])
+{
+    if (std::getenv("R_HOME") == nullptr) {
+        std::cerr << "R_HOME must be set, e.g. R_HOME=$(R RHOME)" << std::endl;
+        return 1;
+    }
+
+    int repeat = bench::int_option(argc, argv, "--repeat", 1);
+    auto files = scenario_files(argc, argv);
+
+    auto r_argv = bench::r_arguments(argv[0]);
+    auto interpreter = std::make_unique<xeus_r::interpreter>(static_cast<int>(r_argv.size()), r_argv.data());
+
+    int status = 0;
+    auto benchmark = [&](bench::memory_server& server) {
+        nl::json result = nl::json::object();
+        for (auto& file: files) {
+            std::ifstream in(file);
+            if (!in) {
+                std::cerr << "could not read " << file << std::endl;
+                status = 1;
+                continue;
+            }
+            try {
+                nl::json scenario = nl::json::parse(in);
+                scenario_runner runner(server);
+                runner.setup(scenario.value("setup", nl::json::array()));
+                result[scenario.value("name", file)] = runner.run(scenario.at("steps"), repeat);
+            } catch (const std::exception& e) {
+                std::cerr << file << ": " << e.what() << std::endl;
+                status = 1;
+            }
+        }
+        std::cout << result.dump(2) << std::endl;
+    };
+
+    xeus::xkernel kernel(xeus::get_user_name(),
+                         xeus::make_empty_context(),
+                         std::move(interpreter),
+                         bench::make_memory_server_builder(benchmark));
+    kernel.start();
+
+    return status;
+}
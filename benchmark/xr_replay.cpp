@@ -0,0 +1,174 @@
+/***************************************************************************
+* Copyright (c) 2023, QuantStack
+*
+* Distributed under the terms of the GNU General Public License v3.
+*
+* The full license is in the file LICENSE, distributed with this software.
+****************************************************************************/
+
+// Replays a capture recorded by a kernel started with XEUS_R_CAPTURE=<file>
+// against an in-process interpreter:
+//
+//   xr-replay [--speed original|max] capture.log
+//
+// At the original speed, messages are dispatched at the time they arrived
+// in the captured session, unless the replay is late. At max speed they are
+// dispatched one after the other. Shutdown and interrupt requests are not
+// replayed, input replies answer the input requests in order.
+//
+// Prints, for each message type, the latencies of the captured session
+// (arrival until the kernel is idle again) and of the replay, as json.
+
+#include <chrono>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "xeus/xeus_context.hpp"
+#include "xeus/xkernel.hpp"
+
+#include "xeus-r/xcapture.hpp"
+#include "xeus-r/xinterpreter.hpp"
+
+#include "bench_utils.hpp"
+#include "memory_server.hpp"
+
+namespace bench = xeus_r::bench;
+
+namespace {
+
+    std::string string_option(int argc, char* argv[], const std::string& name, const std::string& fallback) {
+        for (int i = 1; i + 1 < argc; i++) {
+            if (name == argv[i]) {
+                return argv[i + 1];
+            }
+        }
+        return fallback;
+    }
+
+    std::string msg_type(const nl::json& message) {
+        return message.at("header").value("msg_type", "");
+    }
+
+    bool is_replayed(const xeus_r::captured_message& m) {
+        if (m.channel != xeus_r::capture_channel::shell && m.channel != xeus_r::capture_channel::control) {
+            return false;
+        }
+        std::string type = msg_type(m.message);
+        return type != "shutdown_request" && type != "interrupt_request";
+    }
+
+    // latencies of the captured session, from the arrival of the request
+    // to the idle status published for it
+    std::map<std::string, std::vector<double>> captured_latencies(const std::vector<xeus_r::captured_message>& log) {
+        std::map<std::string, std::pair<std::string, std::uint64_t>> arrivals;
+        std::map<std::string, std::vector<double>> out;
+        for (const auto& m: log) {
+            if (is_replayed(m)) {
+                arrivals[m.message.at("header").value("msg_id", "")] = {msg_type(m.message), m.time_ns};
+                continue;
+            }
+            if (m.channel != xeus_r::capture_channel::iopub || msg_type(m.message) != "status"
+                || m.message.at("content").value("execution_state", "") != "idle") {
+                continue;
+            }
+            auto it = arrivals.find(m.message.at("parent_header").value("msg_id", ""));
+            if (it != arrivals.end()) {
+                out[it->second.first].push_back((m.time_ns - it->second.second) * 1e-9);
+                arrivals.erase(it);
+            }
+        }
+        return out;
+    }
+
+}
+
+int main(int argc, char* argv[])
+{
+    if (std::getenv("R_HOME") == nullptr) {
+        std::cerr << "R_HOME must be set, e.g. R_HOME=$(R RHOME)" << std::endl;
+        return 1;
+    }
+    if (argc < 2 || std::string(argv[argc - 1]).rfind("--", 0) == 0) {
+        std::cerr << "usage: xr-replay [--speed original|max] capture.log" << std::endl;
+        return 1;
+    }
+    bool original_speed = string_option(argc, argv, "--speed", "original") == "original";
+
+    std::vector<xeus_r::captured_message> log;
+    try {
+        xeus_r::capture_reader reader(argv[argc - 1]);
+        xeus_r::captured_message m;
+        while (reader.next(m)) {
+            log.push_back(std::move(m));
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return 1;
+    }
+
+    auto r_argv = bench::r_arguments(argv[0]);
+    auto interpreter = std::make_unique<xeus_r::interpreter>(static_cast<int>(r_argv.size()), r_argv.data());
+
+    auto replay = [&](bench::memory_server& server) {
+        std::size_t captured_published = 0;
+        for (const auto& m: log) {
+            if (m.channel == xeus_r::capture_channel::stdin_channel) {
+                server.queue_input_reply(xeus_r::to_xmessage(m.message));
+            } else if (m.channel == xeus_r::capture_channel::iopub) {
+                captured_published++;
+            }
+        }
+
+        std::map<std::string, std::vector<double>> latencies;
+        std::size_t published = server.published_count();
+        std::uint64_t first = log.empty() ? 0 : log.front().time_ns;
+        auto start = std::chrono::steady_clock::now();
+
+        for (const auto& m: log) {
+            if (!is_replayed(m)) {
+                continue;
+            }
+            if (original_speed) {
+                std::this_thread::sleep_until(start + std::chrono::nanoseconds(m.time_ns - first));
+            }
+            auto channel = m.channel == xeus_r::capture_channel::control ? xeus::channel::CONTROL : xeus::channel::SHELL;
+            auto begin = std::chrono::steady_clock::now();
+            server.dispatch(channel, xeus_r::to_xmessage(m.message));
+            latencies[msg_type(m.message)].push_back(
+                std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count()
+            );
+        }
+
+        double replay_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        nl::json requests = nl::json::object();
+        for (auto& [type, seconds]: captured_latencies(log)) {
+            requests[type]["captured"] = bench::summarize(seconds);
+        }
+        for (auto& [type, seconds]: latencies) {
+            requests[type]["replay"] = bench::summarize(seconds);
+        }
+
+        nl::json result = {
+            {"speed", original_speed ? "original" : "max"},
+            {"captured_seconds", log.empty() ? 0 : (log.back().time_ns - first) * 1e-9},
+            {"replay_seconds", replay_seconds},
+            {"captured_published", captured_published},
+            {"replay_published", server.published_count() - published},
+            {"requests", requests}
+        };
+        std::cout << result.dump(2) << std::endl;
+    };
+
+    xeus::xkernel kernel(xeus::get_user_name(),
+                         xeus::make_empty_context(),
+                         std::move(interpreter),
+                         bench::make_memory_server_builder(replay));
+    kernel.start();
+
+    return 0;
+}
@@ -0,0 +1,94 @@
+/***************************************************************************
+* Copyright (c) 2023, QuantStack
+*
+* Distributed under the terms of the GNU General Public License v3.
+*
+* The full license is in the file LICENSE, distributed with this software.
+****************************************************************************/
+
+#ifndef XEUS_R_CAPTURE_HPP
+#define XEUS_R_CAPTURE_HPP
+
+#ifdef __GNUC__
+    #pragma GCC diagnostic push
+    #pragma GCC diagnostic ignored "-Wattributes"
+#endif
+
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+
+#include "nlohmann/json.hpp"
+
+#include "xeus_r_config.hpp"
+#include "xeus/xmessage.hpp"
+#include "xeus/xserver.hpp"
+
+namespace nl = nlohmann;
+
+namespace xeus_r
+{
+    // Traffic capture: when XEUS_R_CAPTURE is set to a file name, the kernel
+    // records the shell, control and stdin messages it receives, and the
+    // iopub messages it publishes, so that a session can be replayed later
+    // with xr-replay (see benchmark/).
+    //
+    // The log starts with the 8 bytes "XRCAP\0\0\1", then one record per
+    // message:
+    //
+    //   u8    channel
+    //   u64   nanoseconds since the capture started, little endian
+    //   u32   size of the payload, little endian
+    //         payload: CBOR of {header, parent_header, metadata, content, buffers}
+    //
+    // Shell messages are recorded when they are read from the socket, before
+    // they are queued, so the timestamps are the arrival times.
+    enum class capture_channel : std::uint8_t
+    {
+        shell = 0,
+        control = 1,
+        stdin_channel = 2,
+        iopub = 3
+    };
+
+    struct captured_message
+    {
+        capture_channel channel = capture_channel::shell;
+        std::uint64_t time_ns = 0;
+        nl::json message;
+    };
+
+    // Records the message when the capture is enabled, does nothing otherwise
+    XEUS_R_API void capture_message(capture_channel channel, const xeus::xmessage_base& message);
+
+    XEUS_R_API bool capture_enabled();
+
+    // Wraps the server of the kernel so that the control, stdin and iopub
+    // messages are captured. The shell runner captures the shell messages.
+    XEUS_R_API std::unique_ptr<xeus::xserver> make_capturing_server(std::unique_ptr<xeus::xserver> server);
+
+    class XEUS_R_API capture_reader
+    {
+    public:
+
+        // throws std::runtime_error when the file is not a capture
+        explicit capture_reader(const std::string& path);
+
+        // returns false at the end of the log
+        bool next(captured_message& out);
+
+    private:
+
+        std::ifstream m_in;
+    };
+
+    // The messages of a captured payload
+    XEUS_R_API xeus::xmessage to_xmessage(const nl::json& message);
+}
+
+#ifdef __GNUC__
+    #pragma GCC diagnostic pop
+#endif
+
+#endif
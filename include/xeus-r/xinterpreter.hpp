@@ -15,13 +15,17 @@
     #pragma GCC diagnostic ignored "-Wattributes"
 #endif
 
+#include <deque>
+#include <functional>
 #include <string>
 #include <memory>
+#include <vector>
 
 #include "nlohmann/json.hpp"
 
 #include "xeus_r_config.hpp"
 #include "xeus/xinterpreter.hpp"
+#include "xeus/xmessage.hpp"
 
 namespace nl = nlohmann;
 
@@ -64,6 +68,47 @@ namespace xeus_r
 
     interpreter* get_interpreter();
     void register_r_routines();
+
+    // Removes from the queue of pending shell messages the comm messages
+    // that are superseded by a later message on the same comm, for the comms
+    // that opted in with Comm$coalesce().
+    XEUS_R_API void coalesce_comm_messages(std::deque<xeus::xmessage>& queue);
+
+    // Marks the complete and inspect requests of the queue that
+    // are followed by a request of the same type from the same session: the
+    // frontend has moved on, they get an empty reply when dispatched.
+    XEUS_R_API void supersede_introspection_requests(const std::deque<xeus::xmessage>& queue);
+
+    // Called by the shell runner right before a shell message is dispatched,
+    // to keep what the interpreter API does not pass on, e.g. the cell id of
+    // an execute request.
+    XEUS_R_API void set_dispatched_request(const xeus::xmessage& message);
+
+    // Reads the shell messages that arrived while R is busy, and delivers
+    // the ones for comms that accept re-entrant delivery. Installed by the
+    // shell runner, called at R's polled events and by hera::process_events().
+    using shell_poller = std::function<void()>;
+    XEUS_R_API void set_shell_poller(shell_poller poller);
+
+    // Runs the shell poller, unless it is already running. When `throttle`
+    // is true, this does nothing if the poller ran less than 20ms ago.
+    void process_shell_events(bool throttle);
+
+    // Delivers a comm message to its R handler right away, outside of the
+    // regular dispatch of the kernel, if the comm accepts it with
+    // Comm$reentrant(). Returns false, leaving the message untouched, otherwise.
+    XEUS_R_API bool dispatch_comm_message(xeus::xmessage& message);
+
+    // R event loop integration while the kernel is idle, so that e.g. shiny,
+    // httpuv or promises can make progress between requests.
+    //
+    // idle_file_descriptors() are the file descriptors of R's input handlers,
+    // the shell runner polls them along with the shell socket and calls
+    // run_idle_handlers() when they have activity, or every idle_timeout()
+    // milliseconds (-1 when there is nothing to wait for).
+    XEUS_R_API std::vector<int> idle_file_descriptors();
+    XEUS_R_API int idle_timeout();
+    XEUS_R_API void run_idle_handlers();
 }
 
 #ifdef __GNUC__
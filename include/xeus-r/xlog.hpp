@@ -0,0 +1,49 @@
+/***************************************************************************
+* Copyright (c) 2023, QuantStack
+*
+* Distributed under the terms of the GNU General Public License v3.
+*
+* The full license is in the file LICENSE, distributed with this software.
+****************************************************************************/
+
+#ifndef XEUS_R_LOG_HPP
+#define XEUS_R_LOG_HPP
+
+#ifdef __GNUC__
+    #pragma GCC diagnostic push
+    #pragma GCC diagnostic ignored "-Wattributes"
+#endif
+
+#include <cstddef>
+#include <string>
+
+#include "xeus_r_config.hpp"
+
+namespace xeus_r
+{
+    // Log of the kernel, used by hera::log_debug() and friends.
+    //
+    // Records go to an in-memory ring buffer of the last 1024 records, without
+    // locks, and a background thread writes them to JUPYTER_LOGFILE when set,
+    // to std::clog otherwise. The records of a level above log_level() are
+    // dropped right away. When the writers go faster than the background
+    // thread, the oldest records are overwritten, and their number is logged.
+    //
+    // The levels are those of hera: 0 (nothing), 1 (ERROR), 2 (INFO), 3 (DEBUG).
+    // The initial level is XEUS_R_LOG_LEVEL, 0 when it is not set.
+    XEUS_R_API int log_level();
+    XEUS_R_API void set_log_level(int level);
+
+    XEUS_R_API void log_message(int level, const std::string& message);
+
+    // Writes the records still in the ring buffer to `fd`, whether they
+    // have been written by the background thread or not. Only uses
+    // async-signal-safe functions, for the crash handler of xr.
+    XEUS_R_API void dump_log(int fd);
+}
+
+#ifdef __GNUC__
+    #pragma GCC diagnostic pop
+#endif
+
+#endif
@@ -0,0 +1,523 @@
+/***************************************************************************
+* Copyright (c) 2023, QuantStack
+*
+* Distributed under the terms of the GNU General Public License v3.
+*
+* The full license is in the file LICENSE, distributed with this software.
+****************************************************************************/
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "arrow_ipc.hpp"
+
+// The Arrow IPC metadata (Schema.fbs, Message.fbs) is encoded as flatbuffers,
+// only the handful of tables needed for flat data frames is written here so
+// that xeus-r does not depend on the arrow or flatbuffers libraries.
+//
+// Multi-byte values are written in host order, Arrow says little endian,
+// which is what all the platforms xeus-r runs on use.
+
+namespace xeus_r {
+namespace arrow_ipc {
+
+namespace {
+
+    // Writes flatbuffers front to back: an object is written before the
+    // objects it refers to, which are appended later and linked with patch().
+    // uoffsets only point forward, so this is what flatbuffers expects.
+    class flatbuffer_writer {
+    public:
+
+        struct field {
+            uint16_t id;
+            uint8_t size;       // 1, 2, 4 or 8 bytes, 4 for offsets
+            int64_t value;      // ignored for offsets
+            bool is_offset;
+        };
+
+        static field scalar(uint16_t id, uint8_t size, int64_t value) {
+            return {id, size, value, false};
+        }
+
+        static field offset(uint16_t id) {
+            return {id, 4, 0, true};
+        }
+
+        flatbuffer_writer()
+            : m_buffer(4, 0) // offset to the root table
+        {}
+
+        // Writes a vtable followed by its table, returns the position of
+        // the table. `slots` gets the position of the offset fields by id.
+        size_t table(std::vector<field> fields, std::map<uint16_t, size_t>* slots = nullptr) {
+            uint16_t n = 0;
+            uint8_t alignment = 4;
+            for (const auto& f: fields) {
+                n = std::max<uint16_t>(n, f.id + 1);
+                alignment = std::max(alignment, f.size);
+            }
+
+            // largest fields first so that they are naturally aligned,
+            // the table itself starts with the soffset to the vtable
+            std::stable_sort(fields.begin(), fields.end(), [](const field& a, const field& b) {
+                return a.size > b.size;
+            });
+            std::vector<uint16_t> positions(n, 0);
+            size_t table_size = 4;
+            for (const auto& f: fields) {
+                table_size = round_up(table_size, f.size);
+                positions[f.id] = static_cast<uint16_t>(table_size);
+                table_size += f.size;
+            }
+
+            align(2);
+            size_t vtable = m_buffer.size();
+            push<uint16_t>(static_cast<uint16_t>(4 + 2 * n));
+            push<uint16_t>(static_cast<uint16_t>(table_size));
+            for (auto position: positions) {
+                push<uint16_t>(position);
+            }
+
+            align(alignment);
+            size_t table = m_buffer.size();
+            m_buffer.resize(table + table_size, 0);
+            put<int32_t>(table, static_cast<int32_t>(table - vtable));
+
+            for (const auto& f: fields) {
+                size_t at = table + positions[f.id];
+                if (f.is_offset) {
+                    if (slots) (*slots)[f.id] = at;
+                } else {
+                    switch (f.size) {
+                        case 1: put<int8_t>(at, static_cast<int8_t>(f.value)); break;
+                        case 2: put<int16_t>(at, static_cast<int16_t>(f.value)); break;
+                        case 4: put<int32_t>(at, static_cast<int32_t>(f.value)); break;
+                        default: put<int64_t>(at, f.value); break;
+                    }
+                }
+            }
+
+            return table;
+        }
+
+        size_t string(const std::string& s) {
+            align(4);
+            size_t at = m_buffer.size();
+            push<uint32_t>(static_cast<uint32_t>(s.size()));
+            m_buffer.insert(m_buffer.end(), s.begin(), s.end());
+            m_buffer.push_back(0);
+            return at;
+        }
+
+        // vector of `n` offsets, the positions of the elements go to `slots`
+        size_t offsets(size_t n, std::vector<size_t>& slots) {
+            align(4);
+            size_t at = m_buffer.size();
+            push<uint32_t>(static_cast<uint32_t>(n));
+            slots.clear();
+            for (size_t i = 0; i < n; i++) {
+                slots.push_back(m_buffer.size());
+                push<uint32_t>(0);
+            }
+            return at;
+        }
+
+        // vector of structs made of two longs, i.e. FieldNode and Buffer
+        size_t pairs(const std::vector<std::pair<int64_t, int64_t>>& values) {
+            align(8);
+            if ((m_buffer.size() + 4) % 8 != 0) {
+                push<uint32_t>(0);
+            }
+            size_t at = m_buffer.size();
+            push<uint32_t>(static_cast<uint32_t>(values.size()));
+            for (const auto& value: values) {
+                push<int64_t>(value.first);
+                push<int64_t>(value.second);
+            }
+            return at;
+        }
+
+        void patch(size_t slot, size_t target) {
+            put<uint32_t>(slot, static_cast<uint32_t>(target - slot));
+        }
+
+        std::vector<char> finish(size_t root) {
+            patch(0, root);
+            align(8);
+            return std::move(m_buffer);
+        }
+
+    private:
+
+        static size_t round_up(size_t x, size_t n) {
+            return (x + n - 1) / n * n;
+        }
+
+        void align(size_t n) {
+            m_buffer.resize(round_up(m_buffer.size(), n), 0);
+        }
+
+        template <typename T>
+        void put(size_t at, T value) {
+            std::memcpy(m_buffer.data() + at, &value, sizeof(T));
+        }
+
+        template <typename T>
+        void push(T value) {
+            size_t at = m_buffer.size();
+            m_buffer.resize(at + sizeof(T));
+            put<T>(at, value);
+        }
+
+        std::vector<char> m_buffer;
+    };
+
+    // Message.fbs and Schema.fbs
+    const int16_t metadata_version_v5 = 4;
+
+    enum message_header : uint8_t { header_schema = 1, header_record_batch = 3 };
+
+    enum arrow_type : uint8_t {
+        type_int = 2, type_floating_point = 3, type_utf8 = 5,
+        type_bool = 6, type_date = 8, type_timestamp = 10
+    };
+
+    const int16_t precision_double = 2;
+    const int16_t date_unit_day = 0;
+    const int16_t time_unit_microsecond = 2;
+
+    enum class column_kind { boolean, integer, factor, number, date, timestamp, utf8 };
+
+    column_kind kind_of(SEXP x) {
+        switch (TYPEOF(x)) {
+            case LGLSXP:
+                return column_kind::boolean;
+            case INTSXP:
+                return Rf_isFactor(x) ? column_kind::factor : column_kind::integer;
+            case REALSXP:
+                if (Rf_inherits(x, "Date")) return column_kind::date;
+                if (Rf_inherits(x, "POSIXct")) return column_kind::timestamp;
+                return column_kind::number;
+            case STRSXP:
+                return column_kind::utf8;
+            default:
+                throw std::runtime_error("unsupported column type");
+        }
+    }
+
+    // encapsulated IPC message without its body: continuation marker,
+    // metadata size and the flatbuffer, padded to 8 bytes
+    xeus::binary_buffer encapsulate(const std::vector<char>& metadata) {
+        xeus::binary_buffer out(8 + metadata.size());
+        int32_t continuation = -1;
+        int32_t size = static_cast<int32_t>(metadata.size());
+        std::memcpy(out.data(), &continuation, 4);
+        std::memcpy(out.data() + 4, &size, 4);
+        std::memcpy(out.data() + 8, metadata.data(), metadata.size());
+        return out;
+    }
+
+    // writes the Message table, returns the slot of its header
+    size_t message(flatbuffer_writer& fb, message_header header, int64_t body_length, size_t& root) {
+        std::map<uint16_t, size_t> slots;
+        root = fb.table({
+            flatbuffer_writer::scalar(0, 2, metadata_version_v5),
+            flatbuffer_writer::scalar(1, 1, header),
+            flatbuffer_writer::offset(2),
+            flatbuffer_writer::scalar(3, 8, body_length)
+        }, &slots);
+        return slots[2];
+    }
+
+    size_t field_type(flatbuffer_writer& fb, column_kind kind, SEXP x) {
+        switch (kind) {
+            case column_kind::boolean:
+            case column_kind::factor:
+            case column_kind::utf8:
+                return fb.table({});
+
+            case column_kind::integer:
+                return fb.table({
+                    flatbuffer_writer::scalar(0, 4, 32),
+                    flatbuffer_writer::scalar(1, 1, 1)
+                });
+
+            case column_kind::number:
+                return fb.table({ flatbuffer_writer::scalar(0, 2, precision_double) });
+
+            case column_kind::date:
+                return fb.table({ flatbuffer_writer::scalar(0, 2, date_unit_day) });
+
+            case column_kind::timestamp: {
+                SEXP tz = Rf_getAttrib(x, Rf_install("tzone"));
+                bool has_tz = TYPEOF(tz) == STRSXP && XLENGTH(tz) > 0 && STRING_ELT(tz, 0) != NA_STRING
+                    && CHAR(STRING_ELT(tz, 0))[0] != '\0';
+
+                std::map<uint16_t, size_t> slots;
+                std::vector<flatbuffer_writer::field> fields = { flatbuffer_writer::scalar(0, 2, time_unit_microsecond) };
+                if (has_tz) {
+                    fields.push_back(flatbuffer_writer::offset(1));
+                }
+                size_t table = fb.table(fields, &slots);
+                if (has_tz) {
+                    fb.patch(slots[1], fb.string(Rf_translateCharUTF8(STRING_ELT(tz, 0))));
+                }
+                return table;
+            }
+        }
+        return 0;
+    }
+
+    uint8_t type_id(column_kind kind) {
+        switch (kind) {
+            case column_kind::boolean:   return type_bool;
+            case column_kind::integer:   return type_int;
+            case column_kind::number:    return type_floating_point;
+            case column_kind::date:      return type_date;
+            case column_kind::timestamp: return type_timestamp;
+            case column_kind::factor:
+            case column_kind::utf8:      return type_utf8;
+        }
+        return 0;
+    }
+
+    bool is_missing(SEXP x, column_kind kind, R_xlen_t i) {
+        switch (kind) {
+            case column_kind::boolean:
+                return LOGICAL(x)[i] == NA_LOGICAL;
+            case column_kind::integer:
+            case column_kind::factor:
+                return INTEGER(x)[i] == NA_INTEGER;
+            case column_kind::number:
+                return ISNA(REAL(x)[i]);
+            case column_kind::date:
+            case column_kind::timestamp:
+                return !std::isfinite(REAL(x)[i]);
+            case column_kind::utf8:
+                return STRING_ELT(x, i) == NA_STRING;
+        }
+        return false;
+    }
+
+    // Body of a record batch: buffers are 8-byte aligned and their
+    // (offset, length) relative to the start of the body are recorded
+    class body_writer {
+    public:
+
+        // returns the offset of the new buffer, use at() to write it as
+        // allocating may move the body
+        size_t allocate(size_t length) {
+            size_t offset = m_body.size();
+            m_buffers.emplace_back(static_cast<int64_t>(offset), static_cast<int64_t>(length));
+            m_body.resize(offset + (length + 7) / 8 * 8, 0);
+            return offset;
+        }
+
+        template <typename T = char>
+        T* at(size_t offset) {
+            return reinterpret_cast<T*>(m_body.data() + offset);
+        }
+
+        void node(int64_t length, int64_t null_count) {
+            m_nodes.emplace_back(length, null_count);
+        }
+
+        std::vector<char> m_body;
+        std::vector<std::pair<int64_t, int64_t>> m_buffers;
+        std::vector<std::pair<int64_t, int64_t>> m_nodes;
+    };
+
+    void set_bit(char* bits, R_xlen_t i) {
+        bits[i / 8] = static_cast<char>(bits[i / 8] | (1 << (i % 8)));
+    }
+
+    void write_utf8(body_writer& body, SEXP x, column_kind kind, R_xlen_t offset, R_xlen_t length) {
+        SEXP levels = kind == column_kind::factor ? Rf_getAttrib(x, R_LevelsSymbol) : R_NilValue;
+
+        // sizes first, so that the data buffer is allocated once
+        std::vector<const char*> strings(length);
+        std::vector<size_t> sizes(length, 0);
+        int64_t total = 0;
+        for (R_xlen_t i = 0; i < length; i++) {
+            SEXP s;
+            if (kind == column_kind::factor) {
+                int code = INTEGER(x)[offset + i];
+                s = code == NA_INTEGER ? NA_STRING : STRING_ELT(levels, code - 1);
+            } else {
+                s = STRING_ELT(x, offset + i);
+            }
+            if (s != NA_STRING) {
+                strings[i] = Rf_translateCharUTF8(s);
+                sizes[i] = std::strlen(strings[i]);
+                total += static_cast<int64_t>(sizes[i]);
+            }
+        }
+        if (total > INT32_MAX) {
+            throw std::runtime_error("too much string data in a record batch, use smaller chunks");
+        }
+
+        size_t offsets = body.allocate(sizeof(int32_t) * static_cast<size_t>(length + 1));
+        size_t data = body.allocate(static_cast<size_t>(total));
+
+        int32_t position = 0;
+        body.at<int32_t>(offsets)[0] = 0;
+        for (R_xlen_t i = 0; i < length; i++) {
+            if (sizes[i] > 0) {
+                std::memcpy(body.at(data) + position, strings[i], sizes[i]);
+                position += static_cast<int32_t>(sizes[i]);
+            }
+            body.at<int32_t>(offsets)[i + 1] = position;
+        }
+    }
+
+    void write_column(body_writer& body, SEXP x, R_xlen_t offset, R_xlen_t length) {
+        column_kind kind = kind_of(x);
+
+        // validity bitmap, omitted when there are no missing values
+        int64_t null_count = 0;
+        for (R_xlen_t i = 0; i < length; i++) {
+            if (is_missing(x, kind, offset + i)) null_count++;
+        }
+        body.node(length, null_count);
+
+        if (null_count == 0) {
+            body.allocate(0);
+        } else {
+            char* validity = body.at(body.allocate(static_cast<size_t>((length + 7) / 8)));
+            for (R_xlen_t i = 0; i < length; i++) {
+                if (!is_missing(x, kind, offset + i)) set_bit(validity, i);
+            }
+        }
+
+        switch (kind) {
+            case column_kind::boolean: {
+                char* values = body.at(body.allocate(static_cast<size_t>((length + 7) / 8)));
+                const int* p = LOGICAL(x) + offset;
+                for (R_xlen_t i = 0; i < length; i++) {
+                    if (p[i] != NA_LOGICAL && p[i]) set_bit(values, i);
+                }
+                break;
+            }
+
+            // same layout in R and Arrow: the data is copied once, straight
+            // into the body that is then moved to the comm buffers
+            case column_kind::integer: {
+                size_t n = sizeof(int) * static_cast<size_t>(length);
+                std::memcpy(body.at(body.allocate(n)), INTEGER(x) + offset, n);
+                break;
+            }
+
+            case column_kind::number: {
+                size_t n = sizeof(double) * static_cast<size_t>(length);
+                std::memcpy(body.at(body.allocate(n)), REAL(x) + offset, n);
+                break;
+            }
+
+            case column_kind::date: {
+                int32_t* values = body.at<int32_t>(body.allocate(sizeof(int32_t) * static_cast<size_t>(length)));
+                const double* p = REAL(x) + offset;
+                for (R_xlen_t i = 0; i < length; i++) {
+                    values[i] = std::isfinite(p[i]) ? static_cast<int32_t>(std::floor(p[i])) : 0;
+                }
+                break;
+            }
+
+            case column_kind::timestamp: {
+                int64_t* values = body.at<int64_t>(body.allocate(sizeof(int64_t) * static_cast<size_t>(length)));
+                const double* p = REAL(x) + offset;
+                for (R_xlen_t i = 0; i < length; i++) {
+                    values[i] = std::isfinite(p[i]) ? static_cast<int64_t>(std::llround(p[i] * 1e6)) : 0;
+                }
+                break;
+            }
+
+            case column_kind::factor:
+            case column_kind::utf8:
+                write_utf8(body, x, kind, offset, length);
+                break;
+        }
+    }
+
+}
+
+xeus::binary_buffer schema(SEXP columns) {
+    SEXP names = Rf_getAttrib(columns, R_NamesSymbol);
+    R_xlen_t n = XLENGTH(columns);
+
+    flatbuffer_writer fb;
+    size_t root;
+    size_t header_slot = message(fb, header_schema, 0, root);
+
+    std::map<uint16_t, size_t> schema_slots;
+    fb.patch(header_slot, fb.table({ flatbuffer_writer::offset(1) }, &schema_slots));
+
+    std::vector<size_t> field_slots;
+    fb.patch(schema_slots[1], fb.offsets(static_cast<size_t>(n), field_slots));
+
+    for (R_xlen_t j = 0; j < n; j++) {
+        SEXP x = VECTOR_ELT(columns, j);
+        column_kind kind = kind_of(x);
+
+        std::map<uint16_t, size_t> slots;
+        size_t field = fb.table({
+            flatbuffer_writer::offset(0),               // name
+            flatbuffer_writer::scalar(1, 1, 1),         // nullable
+            flatbuffer_writer::scalar(2, 1, type_id(kind)),
+            flatbuffer_writer::offset(3),               // type
+            flatbuffer_writer::offset(5)                // children, required by arrow C++
+        }, &slots);
+        fb.patch(field_slots[j], field);
+
+        std::string name = Rf_isNull(names) ? "" : Rf_translateCharUTF8(STRING_ELT(names, j));
+        fb.patch(slots[0], fb.string(name));
+        fb.patch(slots[3], field_type(fb, kind, x));
+
+        std::vector<size_t> no_children;
+        fb.patch(slots[5], fb.offsets(0, no_children));
+    }
+
+    return encapsulate(fb.finish(root));
+}
+
+xeus::buffer_sequence record_batch(SEXP columns, R_xlen_t offset, R_xlen_t length) {
+    body_writer body;
+    R_xlen_t n = XLENGTH(columns);
+    for (R_xlen_t j = 0; j < n; j++) {
+        write_column(body, VECTOR_ELT(columns, j), offset, length);
+    }
+
+    flatbuffer_writer fb;
+    size_t root;
+    size_t header_slot = message(fb, header_record_batch, static_cast<int64_t>(body.m_body.size()), root);
+
+    std::map<uint16_t, size_t> slots;
+    fb.patch(header_slot, fb.table({
+        flatbuffer_writer::scalar(0, 8, length),
+        flatbuffer_writer::offset(1),
+        flatbuffer_writer::offset(2)
+    }, &slots));
+    fb.patch(slots[1], fb.pairs(body.m_nodes));
+    fb.patch(slots[2], fb.pairs(body.m_buffers));
+
+    xeus::buffer_sequence out;
+    out.push_back(encapsulate(fb.finish(root)));
+    out.push_back(std::move(body.m_body));
+    return out;
+}
+
+xeus::binary_buffer eos() {
+    xeus::binary_buffer out(8, 0);
+    int32_t continuation = -1;
+    std::memcpy(out.data(), &continuation, 4);
+    return out;
+}
+
+}
+}
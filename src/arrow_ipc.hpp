@@ -0,0 +1,43 @@
+/***************************************************************************
+* Copyright (c) 2023, QuantStack
+*
+* Distributed under the terms of the GNU General Public License v3.
+*
+* The full license is in the file LICENSE, distributed with this software.
+****************************************************************************/
+
+#ifndef XEUS_R_ARROW_IPC_HPP
+#define XEUS_R_ARROW_IPC_HPP
+
+#define R_NO_REMAP
+
+#include "R.h"
+#include "Rinternals.h"
+
+#include "xeus/xmessage.hpp"
+
+namespace xeus_r {
+namespace arrow_ipc {
+
+// Encoding of R data frames as an Apache Arrow IPC stream:
+//
+//   schema() record_batch(0, n) record_batch(n, n) ... eos()
+//
+// Each function returns the buffers of one encapsulated IPC message, a
+// record batch comes as its metadata followed by its body so that the body
+// does not have to be copied again. Concatenated, the buffers make a valid
+// stream.
+//
+// `columns` is a named list of logical, integer, factor, double, Date,
+// POSIXct or character vectors. Integer and double columns are copied as
+// is into the message body (R and Arrow share their layout), missing
+// values only add a validity bitmap.
+
+xeus::binary_buffer schema(SEXP columns);
+xeus::buffer_sequence record_batch(SEXP columns, R_xlen_t offset, R_xlen_t length);
+xeus::binary_buffer eos();
+
+}
+}
+
+#endif
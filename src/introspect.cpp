@@ -0,0 +1,57 @@
+/***************************************************************************
+* Copyright (c) 2023, QuantStack
+*
+* Distributed under the terms of the GNU General Public License v3.
+*
+* The full license is in the file LICENSE, distributed with this software.
+****************************************************************************/
+
+#include "introspect.hpp"
+
+namespace xeus_r {
+namespace routines {
+
+namespace {
+
+    // lazyLoadDBfetch(key, file, compressed, hook) only reads the object
+    bool is_lazy_load(SEXP code) {
+        return TYPEOF(code) == LANGSXP && CAR(code) == Rf_install("lazyLoadDBfetch");
+    }
+
+}
+
+SEXP lookup(SEXP name_, SEXP env_, SEXP inherits_) {
+    SEXP sym = Rf_installChar(STRING_ELT(name_, 0));
+    bool inherits = Rf_asLogical(inherits_) == TRUE;
+
+    for (SEXP env = env_; env != R_EmptyEnv; env = inherits ? ENCLOS(env) : R_EmptyEnv) {
+        if (!R_existsVarInFrame(env, sym)) {
+            continue;
+        }
+        if (R_BindingIsActive(sym, env)) {
+            return R_NilValue;
+        }
+
+        SEXP value = Rf_findVarInFrame(env, sym);
+        if (TYPEOF(value) == PROMSXP) {
+            if (PRVALUE(value) != R_UnboundValue) {
+                value = PRVALUE(value);
+            } else if (is_lazy_load(PRCODE(value))) {
+                value = Rf_eval(value, R_BaseEnv);
+            } else {
+                return R_NilValue;
+            }
+        }
+
+        PROTECT(value);
+        SEXP out = PROTECT(Rf_allocVector(VECSXP, 1));
+        SET_VECTOR_ELT(out, 0, value);
+        UNPROTECT(2);
+        return out;
+    }
+
+    return R_NilValue;
+}
+
+}
+}
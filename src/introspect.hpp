@@ -0,0 +1,30 @@
+/***************************************************************************
+* Copyright (c) 2023, QuantStack
+*
+* Distributed under the terms of the GNU General Public License v3.
+*
+* The full license is in the file LICENSE, distributed with this software.
+****************************************************************************/
+
+#ifndef XEUS_R_INTROSPECT_HPP
+#define XEUS_R_INTROSPECT_HPP
+
+#define R_NO_REMAP
+
+#include "R.h"
+#include "Rinternals.h"
+
+namespace xeus_r {
+namespace routines {
+
+// The value bound to `name` in `env` (or its enclosures when `inherits`),
+// for completion and inspection, without running any code: active bindings
+// are not called, and promises are not forced, except the ones lazy loading
+// package objects. A list holding the value, NULL when there is no value
+// to look at.
+SEXP lookup(SEXP name, SEXP env, SEXP inherits);
+
+}
+}
+
+#endif
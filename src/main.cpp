@@ -29,11 +29,16 @@
 #include "xeus/xhelper.hpp"
 
 #include "xeus-zmq/xzmq_context.hpp"
-#include "xeus-zmq/xserver_zmq.hpp"
+#include "xeus-zmq/xserver_zmq_split.hpp"
+#include "xeus-zmq/xcontrol_default_runner.hpp"
 
+#include "xeus-r/xcapture.hpp"
 #include "xeus-r/xinterpreter.hpp"
+#include "xeus-r/xlog.hpp"
 #include "xeus-r/xeus_r_config.hpp"
 
+#include "xshell_runner.hpp"
+
 #if defined(__GNUC__) && !defined(XEUS_R_EMSCRIPTEN_WASM_BUILD)
 void handler(int sig)
 {
@@ -45,7 +50,12 @@ void handler(int sig)
     // print out all the frames to stderr
     fprintf(stderr, "Error: signal %d:\n", sig);
     backtrace_symbols_fd(array, size, STDERR_FILENO);
-    exit(1);
+
+    // and what was logged before the crash
+    xeus_r::dump_log(STDERR_FILENO);
+
+    // skip static destructors, the log writer thread must not be joined from here
+    _exit(1);
 }
 #endif
 
@@ -63,6 +73,28 @@ std::unique_ptr<xeus::xlogger> make_file_logger(xeus::xlogger::level log_level)
     return xeus::make_file_logger(log_level, logfile);
 }
 
+// R has to run on the main thread, so the shell channel runs there, with
+// the xr shell runner, and the control channel gets its own thread
+std::unique_ptr<xeus::xserver> make_xr_server(xeus::xcontext& context,
+                                              const xeus::xconfiguration& config,
+                                              nl::json::error_handler_t eh)
+{
+    auto server = xeus::make_xserver_shell(
+        context,
+        config,
+        eh,
+        std::make_unique<xeus::xcontrol_default_runner>(),
+        std::make_unique<xeus_r::shell_runner>()
+    );
+
+    // XEUS_R_CAPTURE=<file> records the traffic of the kernel, see xcapture.hpp
+    if (xeus_r::capture_enabled())
+    {
+        return xeus_r::make_capturing_server(std::move(server));
+    }
+    return server;
+}
+
 int main(int argc, char* argv[])
 {
     if (xeus::should_print_version(argc, argv))
@@ -110,7 +142,7 @@ int main(int argc, char* argv[])
                              xeus::get_user_name(),
                              std::move(context),
                              std::move(interpreter),
-                             xeus::make_xserver_default,
+                             make_xr_server,
                              std::move(hist), 
                              std::move(logger));
 
@@ -127,7 +159,7 @@ int main(int argc, char* argv[])
         xeus::xkernel kernel(xeus::get_user_name(),
                              std::move(context),
                              std::move(interpreter),
-                             xeus::make_xserver_default);
+                             make_xr_server);
 
         std::cout << "Getting config" << std::endl;
         const auto& config = kernel.get_config();
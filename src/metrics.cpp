@@ -0,0 +1,36 @@
+/***************************************************************************
+* Copyright (c) 2023, QuantStack
+*
+* Distributed under the terms of the GNU General Public License v3.
+*
+* The full license is in the file LICENSE, distributed with this software.
+****************************************************************************/
+
+#include <map>
+
+#include "metrics.hpp"
+
+namespace xeus_r {
+namespace metrics {
+
+namespace {
+    std::map<std::string, double>& counters() {
+        static std::map<std::string, double> instance;
+        return instance;
+    }
+}
+
+void add(const std::string& name, double value) {
+    counters()[name] += value;
+}
+
+nl::json snapshot() {
+    nl::json out = nl::json::object();
+    for (const auto& counter: counters()) {
+        out[counter.first] = counter.second;
+    }
+    return out;
+}
+
+}
+}
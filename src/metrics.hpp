@@ -0,0 +1,29 @@
+/***************************************************************************
+* Copyright (c) 2023, QuantStack
+*
+* Distributed under the terms of the GNU General Public License v3.
+*
+* The full license is in the file LICENSE, distributed with this software.
+****************************************************************************/
+
+#ifndef XEUS_R_METRICS_HPP
+#define XEUS_R_METRICS_HPP
+
+#include <string>
+
+#include "nlohmann/json.hpp"
+
+namespace nl = nlohmann;
+
+namespace xeus_r {
+namespace metrics {
+
+// Counters of the kernel, e.g. "repr.cache_hits", reported by
+// hera::kernel_metrics(). Only used from the R thread.
+void add(const std::string& name, double value = 1);
+nl::json snapshot();
+
+}
+}
+
+#endif
@@ -0,0 +1,418 @@
+/***************************************************************************
+* Copyright (c) 2023, QuantStack
+*
+* Distributed under the terms of the GNU General Public License v3.
+*
+* The full license is in the file LICENSE, distributed with this software.
+****************************************************************************/
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <initializer_list>
+
+#include "parse_service.hpp"
+
+namespace xeus_r {
+
+namespace {
+
+    bool is_name_start(unsigned char c) {
+        return std::isalpha(c) || c == '.' || c >= 0x80;
+    }
+
+    bool is_name_char(unsigned char c) {
+        return std::isalnum(c) || c == '.' || c == '_' || c >= 0x80;
+    }
+
+    // end of the string starting with the quote at `pos`, npos when not terminated
+    std::size_t string_end(const std::string& s, std::size_t pos) {
+        char quote = s[pos];
+        for (std::size_t i = pos + 1; i < s.size(); i++) {
+            if (s[i] == '\\') i++;
+            else if (s[i] == quote) return i + 1;
+        }
+        return std::string::npos;
+    }
+
+    // r"(...)", R'[...]', r"---{...}---", ... starting at `pos`, the r
+    std::size_t raw_string_end(const std::string& s, std::size_t pos) {
+        char quote = s[pos + 1];
+        std::size_t i = pos + 2;
+        std::size_t dashes = 0;
+        while (i < s.size() && s[i] == '-') { i++; dashes++; }
+        if (i == s.size()) return std::string::npos;
+
+        char close;
+        switch (s[i]) {
+            case '(': close = ')'; break;
+            case '[': close = ']'; break;
+            case '{': close = '}'; break;
+            default: return std::string::npos;
+        }
+        std::string terminator = close + std::string(dashes, '-') + quote;
+        std::size_t found = s.find(terminator, i + 1);
+        return found == std::string::npos ? found : found + terminator.size();
+    }
+
+    bool is_raw_string(const std::string& s, std::size_t pos) {
+        return (s[pos] == 'r' || s[pos] == 'R') && pos + 1 < s.size() && (s[pos + 1] == '"' || s[pos + 1] == '\'');
+    }
+
+    const char* operators[] = {
+        ":::", "<<-", "->>", "::", "|>", "<-", "->", "<=", ">=", "==", "!=", "&&", "||"
+    };
+
+    // the next token at or after `pos`, false at the end of the code
+    bool next_token(const std::string& s, std::size_t pos, token& out, bool& unterminated) {
+        // white space and comments
+        while (pos < s.size()) {
+            unsigned char c = s[pos];
+            if (c == '#') {
+                pos = s.find('\n', pos);
+                if (pos == std::string::npos) return false;
+            } else if (std::isspace(c)) {
+                pos++;
+            } else {
+                break;
+            }
+        }
+        if (pos >= s.size()) {
+            return false;
+        }
+
+        out.begin = pos;
+        unsigned char c = s[pos];
+
+        auto terminate = [&](token_kind kind, std::size_t end) {
+            out.kind = kind;
+            if (end == std::string::npos) {
+                unterminated = true;
+                end = s.size();
+            }
+            out.end = end;
+            return true;
+        };
+
+        if (is_raw_string(s, pos)) {
+            return terminate(token_kind::string, raw_string_end(s, pos));
+        }
+        if (c == '"' || c == '\'') {
+            return terminate(token_kind::string, string_end(s, pos));
+        }
+        if (c == '`') {
+            return terminate(token_kind::identifier, string_end(s, pos));
+        }
+        if (std::isdigit(c) || (c == '.' && pos + 1 < s.size() && std::isdigit(static_cast<unsigned char>(s[pos + 1])))) {
+            std::size_t i = pos + 1;
+            while (i < s.size()) {
+                unsigned char d = s[i];
+                bool exponent_sign = (d == '+' || d == '-') && (s[i - 1] == 'e' || s[i - 1] == 'E' || s[i - 1] == 'p' || s[i - 1] == 'P');
+                if (!(std::isalnum(d) || d == '.' || exponent_sign)) break;
+                i++;
+            }
+            return terminate(token_kind::number, i);
+        }
+        if (is_name_start(c)) {
+            std::size_t i = pos + 1;
+            while (i < s.size() && is_name_char(s[i])) i++;
+            return terminate(token_kind::identifier, i);
+        }
+
+        switch (c) {
+            case '(': case '[': case '{':
+                return terminate(token_kind::open, pos + 1);
+            case ')': case ']': case '}':
+                return terminate(token_kind::close, pos + 1);
+            case ',':
+                return terminate(token_kind::comma, pos + 1);
+            case ';':
+                return terminate(token_kind::semicolon, pos + 1);
+            case '%': {
+                std::size_t end = s.find_first_of("%\n", pos + 1);
+                if (end != std::string::npos && s[end] == '%') {
+                    return terminate(token_kind::op, end + 1);
+                }
+                return terminate(token_kind::op, pos + 1);
+            }
+        }
+
+        for (const char* op: operators) {
+            if (s.compare(pos, std::strlen(op), op) == 0) {
+                return terminate(token_kind::op, pos + std::strlen(op));
+            }
+        }
+        return terminate(token_kind::op, pos + 1);
+    }
+
+    void tokenize(parsed_code& parsed, std::size_t pos, const parsed_code* previous, std::size_t resync_from, std::ptrdiff_t delta) {
+        token t;
+        bool unterminated = false;
+        while (next_token(parsed.code, pos, t, unterminated)) {
+            // the rest of the code is the end of the previous code: when a
+            // token starts where one of the previous code did, the tokens
+            // from there are the same, only shifted
+            if (previous && t.begin >= resync_from) {
+                std::size_t old_begin = static_cast<std::size_t>(static_cast<std::ptrdiff_t>(t.begin) - delta);
+                auto it = std::lower_bound(previous->tokens.begin(), previous->tokens.end(), old_begin, [](const token& tok, std::size_t b) {
+                    return tok.begin < b;
+                });
+                if (it != previous->tokens.end() && it->begin == old_begin) {
+                    for (; it != previous->tokens.end(); ++it) {
+                        parsed.tokens.push_back({
+                            it->kind,
+                            static_cast<std::size_t>(static_cast<std::ptrdiff_t>(it->begin) + delta),
+                            static_cast<std::size_t>(static_cast<std::ptrdiff_t>(it->end) + delta)
+                        });
+                    }
+                    parsed.unterminated = previous->unterminated;
+                    return;
+                }
+            }
+            parsed.tokens.push_back(t);
+            pos = t.end;
+        }
+        parsed.unterminated = unterminated;
+    }
+
+    // compared by blocks with memcmp, which is much faster than bytewise
+    std::size_t common_prefix(const std::string& a, const std::string& b) {
+        const std::size_t block = 256;
+        std::size_t n = std::min(a.size(), b.size());
+        std::size_t i = 0;
+        while (i + block <= n && std::memcmp(a.data() + i, b.data() + i, block) == 0) i += block;
+        while (i < n && a[i] == b[i]) i++;
+        return i;
+    }
+
+    std::size_t common_suffix(const std::string& a, const std::string& b, std::size_t max) {
+        const std::size_t block = 256;
+        std::size_t n = std::min(max, std::min(a.size(), b.size()));
+        std::size_t i = 0;
+        while (i + block <= n && std::memcmp(a.data() + a.size() - i - block, b.data() + b.size() - i - block, block) == 0) i += block;
+        while (i < n && a[a.size() - i - 1] == b[b.size() - i - 1]) i++;
+        return i;
+    }
+
+    bool is_op(const parsed_code& parsed, std::size_t i, std::initializer_list<const char*> ops) {
+        const token& t = parsed.tokens[i];
+        if (t.kind != token_kind::op) return false;
+        for (const char* op: ops) {
+            if (parsed.code.compare(t.begin, t.end - t.begin, op) == 0) return true;
+        }
+        return false;
+    }
+
+    bool is_accessor(const parsed_code& parsed, std::size_t i) {
+        return is_op(parsed, i, {"::", ":::", "$", "@"});
+    }
+
+    char closing_bracket(char open) {
+        return open == '(' ? ')' : open == '[' ? ']' : '}';
+    }
+
+}
+
+parsed_code& parse_service::parse(const std::string& code) {
+    auto same = std::find_if(m_documents.begin(), m_documents.end(), [&](const parsed_code& p) {
+        return p.code == code;
+    });
+    if (same != m_documents.end()) {
+        m_documents.splice(m_documents.begin(), m_documents, same);
+        return m_documents.front();
+    }
+
+    // the recent code that shares the most with this one
+    const parsed_code* previous = nullptr;
+    std::size_t prefix = 0, suffix = 0, best = 0;
+    for (const auto& p: m_documents) {
+        std::size_t pre = common_prefix(p.code, code);
+        std::size_t suf = common_suffix(p.code, code, std::min(p.code.size(), code.size()) - pre);
+        if (pre + suf > best || previous == nullptr) {
+            previous = &p;
+            prefix = pre;
+            suffix = suf;
+            best = pre + suf;
+        }
+        // a few characters typed or deleted, no need to look further
+        if (best + 64 >= code.size()) {
+            break;
+        }
+    }
+
+    parsed_code parsed;
+    parsed.code = code;
+
+    if (previous == nullptr || best == 0) {
+        tokenize(parsed, 0, nullptr, 0, 0);
+    } else {
+        // tokens that end before the line of the edit keep their meaning:
+        // tokenizing looks ahead a few characters, `%` to the end of the line
+        std::size_t line = prefix == 0 ? 0 : code.rfind('\n', prefix - 1);
+        line = line == std::string::npos ? 0 : line;
+        auto kept = std::lower_bound(previous->tokens.begin(), previous->tokens.end(), line, [](const token& t, std::size_t l) {
+            return t.end < l;
+        });
+        parsed.tokens.reserve(previous->tokens.size() + 16);
+        parsed.tokens.assign(previous->tokens.begin(), kept);
+        std::size_t pos = parsed.tokens.empty() ? 0 : parsed.tokens.back().end;
+
+        std::ptrdiff_t delta = static_cast<std::ptrdiff_t>(code.size()) - static_cast<std::ptrdiff_t>(previous->code.size());
+        tokenize(parsed, pos, previous, code.size() - suffix, delta);
+    }
+
+    m_documents.push_front(std::move(parsed));
+    if (m_documents.size() > max_documents) {
+        m_documents.pop_back();
+    }
+    return m_documents.front();
+}
+
+parse_service& get_parse_service() {
+    static parse_service service;
+    return service;
+}
+
+std::string bracket_status(const parsed_code& parsed, std::size_t& open_brackets) {
+    std::vector<char> open;
+    for (const auto& t: parsed.tokens) {
+        char c = parsed.code[t.begin];
+        if (t.kind == token_kind::open) {
+            open.push_back(c);
+        } else if (t.kind == token_kind::close) {
+            if (open.empty() || closing_bracket(open.back()) != c) {
+                open_brackets = open.size();
+                return "invalid";
+            }
+            open.pop_back();
+        }
+    }
+
+    open_brackets = open.size();
+    return parsed.unterminated ? "incomplete" : "";
+}
+
+std::vector<std::size_t> top_level_breaks(const parsed_code& parsed) {
+    const auto& tokens = parsed.tokens;
+    std::vector<std::size_t> out;
+    std::size_t depth = 0;
+    for (std::size_t i = 0; i + 1 < tokens.size(); i++) {
+        const auto& t = tokens[i];
+        if (t.kind == token_kind::open) {
+            depth++;
+        } else if (t.kind == token_kind::close && depth > 0) {
+            depth--;
+        }
+        if (depth > 0 || t.kind == token_kind::op || t.kind == token_kind::comma) {
+            continue;
+        }
+        const auto& next = tokens[i + 1];
+        if (std::memchr(parsed.code.data() + t.end, '\n', next.begin - t.end) != nullptr) {
+            out.push_back(next.begin);
+        }
+    }
+    return out;
+}
+
+std::pair<std::size_t, std::size_t> name_at(const parsed_code& parsed, std::size_t cursor) {
+    const auto& tokens = parsed.tokens;
+
+    // the first token that ends at or after the cursor, or the one right
+    // after it when the cursor is between an operator and a name: `x$|y`
+    auto it = std::lower_bound(tokens.begin(), tokens.end(), cursor, [](const token& t, std::size_t c) {
+        return t.end < c;
+    });
+    if (it != tokens.end() && it->kind != token_kind::identifier && it->end == cursor && it + 1 != tokens.end() && (it + 1)->begin == cursor) {
+        ++it;
+    }
+    if (it == tokens.end() || it->begin > cursor || it->kind != token_kind::identifier) {
+        return {cursor, cursor};
+    }
+
+    std::size_t first = static_cast<std::size_t>(it - tokens.begin());
+    std::size_t last = first;
+    while (first >= 2 && is_accessor(parsed, first - 1) && tokens[first - 2].kind == token_kind::identifier) {
+        first -= 2;
+    }
+    while (last + 2 < tokens.size() && is_accessor(parsed, last + 1) && tokens[last + 2].kind == token_kind::identifier) {
+        last += 2;
+    }
+    return {tokens[first].begin, tokens[last].end};
+}
+
+std::size_t string_at(const parsed_code& parsed, std::size_t cursor) {
+    const auto& tokens = parsed.tokens;
+    auto it = std::lower_bound(tokens.begin(), tokens.end(), cursor, [](const token& t, std::size_t c) {
+        return t.end < c;
+    });
+    if (it == tokens.end() || it->kind != token_kind::string || it->begin >= cursor) {
+        return std::string::npos;
+    }
+
+    // right after the closing quote is not in the string, unless there is none
+    bool open = parsed.unterminated && it + 1 == tokens.end();
+    if (cursor == it->end && !open) {
+        return std::string::npos;
+    }
+    // raw strings are not paths
+    char quote = parsed.code[it->begin];
+    if (quote != '"' && quote != '\'') {
+        return std::string::npos;
+    }
+    return it->begin + 1;
+}
+
+bool call_at(const parsed_code& parsed, std::size_t cursor, call_context& context) {
+    const auto& tokens = parsed.tokens;
+
+    // the innermost bracket that is open at the cursor, and the commas
+    // directly in it
+    std::vector<std::pair<std::size_t, int>> open;    // token index, commas
+    for (std::size_t i = 0; i < tokens.size() && tokens[i].begin < cursor; i++) {
+        switch (tokens[i].kind) {
+            case token_kind::open:
+                open.push_back({i, 0});
+                break;
+            case token_kind::close:
+                if (!open.empty()) open.pop_back();
+                break;
+            case token_kind::comma:
+                if (!open.empty()) open.back().second++;
+                break;
+            default:
+                break;
+        }
+    }
+    if (open.empty() || parsed.code[tokens[open.back().first].begin] != '(') {
+        return false;
+    }
+
+    std::size_t paren = open.back().first;
+    if (paren == 0 || tokens[paren - 1].kind != token_kind::identifier) {
+        return false;
+    }
+    auto name = name_at(parsed, tokens[paren - 1].end);
+    context.function = parsed.code.substr(name.first, name.second - name.first);
+    context.argument = open.back().second;
+    return true;
+}
+
+std::size_t utf8_byte_offset(const std::string& s, std::size_t code_points) {
+    std::size_t i = 0;
+    for (; i < s.size() && code_points > 0; code_points--) {
+        // skip the continuation bytes of the code point
+        i++;
+        while (i < s.size() && (static_cast<unsigned char>(s[i]) & 0xC0) == 0x80) i++;
+    }
+    return i;
+}
+
+std::size_t utf8_code_points(const std::string& s, std::size_t bytes) {
+    std::size_t n = 0;
+    for (std::size_t i = 0; i < std::min(bytes, s.size()); i++) {
+        if ((static_cast<unsigned char>(s[i]) & 0xC0) != 0x80) n++;
+    }
+    return n;
+}
+
+}
@@ -0,0 +1,97 @@
+/***************************************************************************
+* Copyright (c) 2023, QuantStack
+*
+* Distributed under the terms of the GNU General Public License v3.
+*
+* The full license is in the file LICENSE, distributed with this software.
+****************************************************************************/
+
+#ifndef XEUS_R_PARSE_SERVICE_HPP
+#define XEUS_R_PARSE_SERVICE_HPP
+
+#include <cstddef>
+#include <list>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace xeus_r {
+
+enum class token_kind { identifier, number, string, op, open, close, comma, semicolon };
+
+struct token {
+    token_kind kind;
+    std::size_t begin;     // byte offsets in the code
+    std::size_t end;
+};
+
+// The tokens of the code of a cell: comments and white space are skipped,
+// a backtick quoted name is an identifier.
+struct parsed_code {
+    std::string code;
+    std::vector<token> tokens;
+
+    // the code ends in a string or a quoted name that is not terminated
+    bool unterminated = false;
+
+    // is_complete status, once known
+    std::string status;
+};
+
+struct call_context {
+    std::string function;    // e.g. "rnorm" or "stats::rnorm"
+    int argument = 0;        // index of the argument under the cursor
+};
+
+// Tokens of the code of the recent cells for the complete, inspect and
+// is_complete handlers, which are sent the whole cell on every request.
+//
+// The code is rarely new: it is usually the code of a recent request with
+// a few characters typed or deleted. The code before the edit keeps its
+// tokens, only the edited part is tokenized until its tokens line up with
+// the ones of the code after the edit, which are reused.
+class parse_service {
+public:
+
+    parsed_code& parse(const std::string& code);
+
+private:
+
+    static constexpr std::size_t max_documents = 8;
+    std::list<parsed_code> m_documents;    // most recently used first
+};
+
+parse_service& get_parse_service();
+
+// "invalid" when a bracket is closed by another one or was not opened,
+// "incomplete" when the code ends in a string that is not terminated,
+// empty when it takes the R parser to tell. `open_brackets` is set to
+// the number of brackets that are not closed.
+std::string bracket_status(const parsed_code& parsed, std::size_t& open_brackets);
+
+// Byte offsets where the code may be split in top-level expressions: the
+// start of a line that follows a token outside of brackets, other than an
+// operator or a comma. A piece that parses as complete code ends there,
+// and R parses what follows on its own. A piece that does not may go on
+// past the offset, e.g. `function(x)` followed by its body.
+std::vector<std::size_t> top_level_breaks(const parsed_code& parsed);
+
+// [begin, end) of the name under the byte offset `cursor`, including its
+// `pkg::`, `obj$` or `obj@` prefixes and suffixes. begin == end when the
+// cursor is not on a name.
+std::pair<std::size_t, std::size_t> name_at(const parsed_code& parsed, std::size_t cursor);
+
+// byte offset of the content of the quoted string the cursor is in, i.e.
+// right after its opening quote, npos when the cursor is not in a string
+std::size_t string_at(const parsed_code& parsed, std::size_t cursor);
+
+// the call whose arguments the byte offset `cursor` is in
+bool call_at(const parsed_code& parsed, std::size_t cursor, call_context& context);
+
+// conversions between offsets in code points (jupyter) and in bytes (utf-8)
+std::size_t utf8_byte_offset(const std::string& s, std::size_t code_points);
+std::size_t utf8_code_points(const std::string& s, std::size_t bytes);
+
+}
+
+#endif
@@ -0,0 +1,128 @@
+/***************************************************************************
+* Copyright (c) 2023, QuantStack
+*
+* Distributed under the terms of the GNU General Public License v3.
+*
+* The full license is in the file LICENSE, distributed with this software.
+****************************************************************************/
+
+#include <algorithm>
+#include <cstdlib>
+#include <system_error>
+
+#include "metrics.hpp"
+#include "path_index.hpp"
+
+namespace fs = std::filesystem;
+
+namespace xeus_r {
+
+namespace {
+
+    std::string home_directory() {
+#ifdef _WIN32
+        const char* home = std::getenv("USERPROFILE");
+#else
+        const char* home = std::getenv("HOME");
+#endif
+        return home ? home : "";
+    }
+
+    fs::path expand(const std::string& dir) {
+        if (dir.empty()) {
+            return fs::current_path();
+        }
+        if (dir[0] == '~' && (dir.size() == 1 || dir[1] == '/')) {
+            return fs::path(home_directory() + dir.substr(1));
+        }
+        return fs::path(dir);
+    }
+
+    // the file time clock is not the system clock before C++20, compare
+    // durations since the modification instead
+    bool is_racy(fs::file_time_type mtime, std::chrono::system_clock::time_point listed_at) {
+        auto age = fs::file_time_type::clock::now() - mtime;
+        auto listed_since = std::chrono::system_clock::now() - listed_at;
+        return age - std::chrono::duration_cast<fs::file_time_type::duration>(listed_since) < std::chrono::seconds(2);
+    }
+
+}
+
+path_index::path_index(std::size_t max_directories)
+    : m_max_directories(max_directories)
+{}
+
+const path_index::listing* path_index::get(const fs::path& dir) {
+    std::error_code ec;
+    fs::path absolute = fs::absolute(dir, ec);
+    if (ec) {
+        return nullptr;
+    }
+    auto mtime = fs::last_write_time(absolute, ec);
+    if (ec) {
+        return nullptr;
+    }
+
+    auto found = m_index.find(absolute.string());
+    if (found != m_index.end()) {
+        m_listings.splice(m_listings.begin(), m_listings, found->second);
+        const listing& cached = m_listings.front();
+        if (cached.mtime == mtime && !is_racy(cached.mtime, cached.listed_at)) {
+            metrics::add("completion.path_cache_hits");
+            return &cached;
+        }
+        m_index.erase(found);
+        m_listings.pop_front();
+    }
+
+    listing fresh { absolute, mtime, std::chrono::system_clock::now(), {} };
+    for (fs::directory_iterator it(absolute, fs::directory_options::skip_permission_denied, ec), end; !ec && it != end; it.increment(ec)) {
+        std::error_code type_ec;
+        fresh.entries.push_back({it->path().filename().string(), it->is_directory(type_ec)});
+    }
+    if (ec) {
+        return nullptr;
+    }
+    std::sort(fresh.entries.begin(), fresh.entries.end(), [](const entry_t& a, const entry_t& b) {
+        return a.name < b.name;
+    });
+
+    m_listings.push_front(std::move(fresh));
+    m_index[absolute.string()] = m_listings.begin();
+    if (m_listings.size() > m_max_directories) {
+        m_index.erase(m_listings.back().dir.string());
+        m_listings.pop_back();
+    }
+    return &m_listings.front();
+}
+
+std::vector<std::string> path_index::complete(const std::string& text, std::size_t limit) {
+    auto slash = text.find_last_of('/');
+    std::string dir = slash == std::string::npos ? "" : text.substr(0, slash + 1);
+    std::string prefix = slash == std::string::npos ? text : text.substr(slash + 1);
+
+    std::vector<std::string> out;
+    const listing* found = get(expand(dir));
+    if (found == nullptr) {
+        return out;
+    }
+
+    bool hidden = !prefix.empty() && prefix[0] == '.';
+    auto it = std::lower_bound(found->entries.begin(), found->entries.end(), prefix, [](const entry_t& e, const std::string& p) {
+        return e.name < p;
+    });
+    for (; it != found->entries.end() && out.size() < limit && it->name.compare(0, prefix.size(), prefix) == 0; ++it) {
+        if (!hidden && it->name[0] == '.') {
+            continue;
+        }
+        out.push_back(dir + it->name + (it->directory ? "/" : ""));
+    }
+    return out;
+}
+
+path_index& get_path_index() {
+    static path_index index;
+    return index;
+}
+
+}
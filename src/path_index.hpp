@@ -0,0 +1,67 @@
+/***************************************************************************
+* Copyright (c) 2023, QuantStack
+*
+* Distributed under the terms of the GNU General Public License v3.
+*
+* The full license is in the file LICENSE, distributed with this software.
+****************************************************************************/
+
+#ifndef XEUS_R_PATH_INDEX_HPP
+#define XEUS_R_PATH_INDEX_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <filesystem>
+#include <list>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace xeus_r {
+
+// Directory listings for completing paths in strings, which would
+// otherwise list the directory on each keystroke: with a large directory
+// on a network mount, that blocks the kernel.
+//
+// The sorted entries of a directory are kept until its modification time
+// changes, i.e. an entry is added, removed or renamed: a request only costs
+// one stat of the directory. A listing made less than 2 seconds after the
+// last modification may have missed a change within the resolution of the
+// file system clock, it is made again at the next request.
+class path_index {
+public:
+
+    explicit path_index(std::size_t max_directories = 64);
+
+    // Paths starting with `text`, relative to the working directory unless
+    // absolute, `~` being the home directory. Directories end in a `/`.
+    // Names starting with a dot only match when the last component of
+    // `text` starts with a dot. At most `limit` paths, in order.
+    std::vector<std::string> complete(const std::string& text, std::size_t limit);
+
+private:
+
+    struct entry_t {
+        std::string name;
+        bool directory;
+    };
+
+    struct listing {
+        std::filesystem::path dir;
+        std::filesystem::file_time_type mtime;
+        std::chrono::system_clock::time_point listed_at;
+        std::vector<entry_t> entries;    // sorted by name
+    };
+
+    const listing* get(const std::filesystem::path& dir);
+
+    std::size_t m_max_directories;
+    std::list<listing> m_listings;    // most recently used first
+    std::unordered_map<std::string, std::list<listing>::iterator> m_index;
+};
+
+path_index& get_path_index();
+
+}
+
+#endif
@@ -0,0 +1,184 @@
+/***************************************************************************
+* Copyright (c) 2023, QuantStack
+*
+* Distributed under the terms of the GNU General Public License v3.
+*
+* The full license is in the file LICENSE, distributed with this software.
+****************************************************************************/
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <string>
+
+#include "progress.hpp"
+#include "xeus-r/xinterpreter.hpp"
+#include "xeus/xguid.hpp"
+#include "nlohmann/json.hpp"
+
+namespace nl = nlohmann;
+
+namespace xeus_r {
+namespace routines {
+
+namespace {
+
+    using clock = std::chrono::steady_clock;
+
+    struct progress {
+        double total;           // NaN when unknown
+        double current = 0;
+        std::string label;
+        std::string display_id = xeus::new_xguid();
+        clock::duration interval;
+        clock::time_point start = clock::now();
+        clock::time_point next_update = start;
+        bool done = false;
+    };
+
+    std::string format_seconds(double seconds) {
+        char buffer[32];
+        long s = static_cast<long>(std::round(seconds));
+        if (s >= 3600) {
+            std::snprintf(buffer, sizeof(buffer), "%ldh%02ldm", s / 3600, (s % 3600) / 60);
+        } else if (s >= 60) {
+            std::snprintf(buffer, sizeof(buffer), "%ldm%02lds", s / 60, s % 60);
+        } else {
+            std::snprintf(buffer, sizeof(buffer), "%lds", s);
+        }
+        return buffer;
+    }
+
+    std::string html_escape(const std::string& s) {
+        std::string out;
+        for (char c: s) {
+            switch (c) {
+                case '&': out += "&amp;"; break;
+                case '<': out += "&lt;"; break;
+                case '>': out += "&gt;"; break;
+                default: out += c;
+            }
+        }
+        return out;
+    }
+
+    nl::json render(const progress& p) {
+        double elapsed = std::chrono::duration<double>(clock::now() - p.start).count();
+        bool known = std::isfinite(p.total) && p.total > 0;
+        double fraction = known ? std::min(1.0, std::max(0.0, p.current / p.total)) : 0;
+
+        char counts[96];
+        if (known) {
+            std::snprintf(counts, sizeof(counts), "%3.0f%% %.0f/%.0f", 100 * fraction, p.current, p.total);
+        } else {
+            std::snprintf(counts, sizeof(counts), "%.0f", p.current);
+        }
+
+        std::string status;
+        if (p.done) {
+            status = "done in " + format_seconds(elapsed);
+        } else if (known && fraction > 0) {
+            status = "eta " + format_seconds(elapsed * (1 - fraction) / fraction);
+        } else {
+            status = format_seconds(elapsed);
+        }
+
+        const int width = 30;
+        int filled = static_cast<int>(fraction * width);
+        std::string bar = known
+            ? "[" + std::string(filled, '=') + std::string(width - filled, ' ') + "]"
+            : "[" + std::string(width, p.done ? '=' : '.') + "]";
+
+        std::string prefix = p.label.empty() ? "" : p.label + " ";
+        std::string text = prefix + bar + " " + counts + " " + status;
+
+        std::string html = "<div>" + html_escape(prefix) + "<progress"
+            + (known ? " value=\"" + std::to_string(p.current) + "\" max=\"" + std::to_string(p.total) + "\"" : std::string())
+            + "></progress> " + counts + " " + status + "</div>";
+
+        return {{"text/plain", text}, {"text/html", html}};
+    }
+
+    void refresh(progress& p, bool first = false) {
+        auto* interpreter = xeus_r::get_interpreter();
+        nl::json transient = {{"display_id", p.display_id}};
+        if (first) {
+            interpreter->display_data(render(p), nl::json::object(), std::move(transient));
+        } else {
+            interpreter->update_display_data(render(p), nl::json::object(), std::move(transient));
+        }
+        p.next_update = clock::now() + p.interval;
+    }
+
+    void delete_progress(SEXP xp) {
+        delete reinterpret_cast<progress*>(R_ExternalPtrAddr(xp));
+        R_ClearExternalPtr(xp);
+    }
+
+    progress* get_progress(SEXP xp) {
+        auto* p = reinterpret_cast<progress*>(R_ExternalPtrAddr(xp));
+        if (!p) {
+            Rf_error("invalid progress object");
+        }
+        return p;
+    }
+
+    // the clock is only read when ticking: this is what a tick costs,
+    // besides the .Call()
+    inline void maybe_refresh(progress& p) {
+        if (!p.done && clock::now() >= p.next_update) {
+            refresh(p);
+        }
+    }
+
+}
+
+SEXP Progress__new(SEXP total_, SEXP label_, SEXP interval_) {
+    auto* p = new progress();
+    p->total = Rf_asReal(total_);
+    if (TYPEOF(label_) == STRSXP && XLENGTH(label_) == 1 && STRING_ELT(label_, 0) != NA_STRING) {
+        p->label = Rf_translateCharUTF8(STRING_ELT(label_, 0));
+    }
+    double interval = std::max(0.0, Rf_asReal(interval_));
+    p->interval = std::chrono::duration_cast<clock::duration>(std::chrono::duration<double>(interval));
+
+    SEXP xp = PROTECT(R_MakeExternalPtr(p, R_NilValue, R_NilValue));
+    R_RegisterCFinalizerEx(xp, delete_progress, TRUE);
+    refresh(*p, /* first = */ true);
+
+    UNPROTECT(1);
+    return xp;
+}
+
+SEXP Progress__tick(SEXP xp_progress, SEXP n_) {
+    auto* p = get_progress(xp_progress);
+    p->current += Rf_asReal(n_);
+    maybe_refresh(*p);
+    return R_NilValue;
+}
+
+SEXP Progress__update(SEXP xp_progress, SEXP value_, SEXP label_) {
+    auto* p = get_progress(xp_progress);
+    p->current = Rf_asReal(value_);
+    if (TYPEOF(label_) == STRSXP && XLENGTH(label_) == 1 && STRING_ELT(label_, 0) != NA_STRING) {
+        p->label = Rf_translateCharUTF8(STRING_ELT(label_, 0));
+    }
+    maybe_refresh(*p);
+    return R_NilValue;
+}
+
+SEXP Progress__done(SEXP xp_progress) {
+    auto* p = get_progress(xp_progress);
+    if (!p->done) {
+        p->done = true;
+        if (std::isfinite(p->total)) {
+            p->current = std::max(p->current, p->total);
+        }
+        refresh(*p);
+    }
+    return Rf_mkString(p->display_id.c_str());
+}
+
+}
+}
@@ -0,0 +1,31 @@
+/***************************************************************************
+* Copyright (c) 2023, QuantStack
+*
+* Distributed under the terms of the GNU General Public License v3.
+*
+* The full license is in the file LICENSE, distributed with this software.
+****************************************************************************/
+
+#ifndef XEUS_R_PROGRESS_HPP
+#define XEUS_R_PROGRESS_HPP
+
+#define R_NO_REMAP
+
+#include "R.h"
+#include "Rinternals.h"
+
+namespace xeus_r {
+namespace routines {
+
+// Progress displays, updated in place: ticks only update a counter, the
+// display is refreshed at most once per `interval` seconds with the
+// latest state (last write wins), and once more when the progress is done.
+SEXP Progress__new(SEXP total_, SEXP label_, SEXP interval_);
+SEXP Progress__tick(SEXP xp_progress, SEXP n_);
+SEXP Progress__update(SEXP xp_progress, SEXP value_, SEXP label_);
+SEXP Progress__done(SEXP xp_progress);
+
+}
+}
+
+#endif
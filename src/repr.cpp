@@ -0,0 +1,106 @@
+/***************************************************************************
+* Copyright (c) 2023, QuantStack
+*
+* Distributed under the terms of the GNU General Public License v3.
+*
+* The full license is in the file LICENSE, distributed with this software.
+****************************************************************************/
+
+#include "repr.hpp"
+
+namespace xeus_r {
+namespace routines {
+
+namespace {
+
+    // adds the elements of `x` to `count`, returns false once over `limit`
+    bool count_elements(SEXP x, double& count, double limit, int depth) {
+        if (depth < 0) {
+            return false;
+        }
+
+        switch (TYPEOF(x)) {
+            case LGLSXP:
+            case INTSXP:
+            case REALSXP:
+            case CPLXSXP:
+            case STRSXP:
+            case RAWSXP:
+                count += static_cast<double>(XLENGTH(x));
+                break;
+
+            case VECSXP:
+            case EXPRSXP: {
+                count += 1;
+                R_xlen_t n = XLENGTH(x);
+                for (R_xlen_t i = 0; i < n && count <= limit; i++) {
+                    if (!count_elements(VECTOR_ELT(x, i), count, limit, depth - 1)) {
+                        return false;
+                    }
+                }
+                break;
+            }
+
+            default:
+                count += 1;
+                break;
+        }
+
+        return count <= limit;
+    }
+
+    bool cacheable(SEXP x, int depth) {
+        if (depth < 0) {
+            return false;
+        }
+
+        switch (TYPEOF(x)) {
+            case ENVSXP:
+            case CLOSXP:
+            case EXTPTRSXP:
+            case WEAKREFSXP:
+            case PROMSXP:
+                return false;
+
+            case VECSXP:
+            case EXPRSXP: {
+                R_xlen_t n = XLENGTH(x);
+                for (R_xlen_t i = 0; i < n; i++) {
+                    if (!cacheable(VECTOR_ELT(x, i), depth - 1)) {
+                        return false;
+                    }
+                }
+                break;
+            }
+
+            default:
+                break;
+        }
+
+        for (SEXP a = ATTRIB(x); a != R_NilValue; a = CDR(a)) {
+            if (!cacheable(CAR(a), depth - 1)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+}
+
+SEXP repr_size(SEXP x, SEXP limit, SEXP max_depth) {
+    double count = 0;
+    double max_count = Rf_asReal(limit);
+    if (!count_elements(x, count, max_count, Rf_asInteger(max_depth))) {
+        // over budget, the exact count is not needed
+        return Rf_ScalarReal(R_PosInf);
+    }
+
+    return Rf_ScalarReal(count);
+}
+
+SEXP repr_cacheable(SEXP x) {
+    return Rf_ScalarLogical(cacheable(x, 50));
+}
+
+}
+}
@@ -0,0 +1,35 @@
+/***************************************************************************
+* Copyright (c) 2023, QuantStack
+*
+* Distributed under the terms of the GNU General Public License v3.
+*
+* The full license is in the file LICENSE, distributed with this software.
+****************************************************************************/
+
+#ifndef XEUS_R_REPR_HPP
+#define XEUS_R_REPR_HPP
+
+#define R_NO_REMAP
+
+#include "R.h"
+#include "Rinternals.h"
+
+namespace xeus_r {
+namespace routines {
+
+// Number of elements of `x`, counting the elements of atomic vectors and
+// recursing into lists, to decide whether it can be displayed in full.
+// Counting stops as soon as `limit` is exceeded and objects nested deeper
+// than `max_depth` count as exceeding the limit. Environments, functions,
+// external pointers, etc... count as one element.
+SEXP repr_size(SEXP x, SEXP limit, SEXP max_depth);
+
+// Whether the repr of `x` can be cached by the digest of `x`: false when
+// `x` refers to environments, closures or external pointers, as their
+// content is not entirely captured by the digest.
+SEXP repr_cacheable(SEXP x);
+
+}
+}
+
+#endif
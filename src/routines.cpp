@@ -1,11 +1,31 @@
 #define R_NO_REMAP
 
+#include <algorithm>
+#include <cstdio>
+#include <iterator>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
 #include "R.h"
 #include "Rinternals.h"
 #include "R_ext/Rdynload.h"
-
+#include "R_ext/Altrep.h"
+
+#include "arrow_ipc.hpp"
+#include "introspect.hpp"
+#include "metrics.hpp"
+#include "parse_service.hpp"
+#include "path_index.hpp"
+#include "progress.hpp"
+#include "repr.hpp"
 #include "rtools.hpp"
+#include "summary.hpp"
+#include "symbol_index.hpp"
+#include "table.hpp"
 #include "xeus-r/xinterpreter.hpp"
+#include "xeus-r/xlog.hpp"
 #include "nlohmann/json.hpp"
 #include "xeus/xmessage.hpp"
 #include "xeus/xcomm.hpp"
@@ -15,19 +35,41 @@ namespace xeus_r {
 namespace routines {
 
 SEXP to_r_json(const nl::json& js) {
-    SEXP out = PROTECT(Rf_mkString(js.dump(4).c_str()));
+    // compact on purpose: this is only meant to be consumed by jsonlite::fromJSON()
+    SEXP out = PROTECT(Rf_mkString(js.dump().c_str()));
     Rf_classgets(out, Rf_mkString("json"));
     UNPROTECT(1);
     
     return out;
 }
 
+void delete_message(SEXP xp) {
+    delete reinterpret_cast<xeus::xmessage*>(R_ExternalPtrAddr(xp));
+}
+
+// Messages are environments of class "Message" that only hold the external
+// pointer to the xeus::xmessage, the fields are materialized on first
+// access by `$.Message` in hera
+SEXP new_message(xeus::xmessage&& message) {
+    static SEXP sym_xp = Rf_install(".xp");
+
+    auto ptr_message = new xeus::xmessage(std::move(message));
+    SEXP xp_message = PROTECT(R_MakeExternalPtr(
+        reinterpret_cast<void*>(ptr_message), R_NilValue, R_NilValue
+    ));
+    R_RegisterCFinalizerEx(xp_message, delete_message, FALSE);
+
+    SEXP env = PROTECT(R_NewEnv(R_EmptyEnv, FALSE, 0));
+    Rf_defineVar(sym_xp, xp_message, env);
+    Rf_classgets(env, Rf_mkString("Message"));
+
+    UNPROTECT(2);
+    return env;
+}
+
 SEXP kernel_info_request() {
     auto info = xeus_r::get_interpreter()->kernel_info_request();
-    SEXP out = PROTECT(Rf_mkString(info.dump(4).c_str()));
-    Rf_classgets(out, Rf_mkString("json"));
-    UNPROTECT(1);
-    return out;
+    return to_r_json(info);
 }
 
 SEXP publish_stream(SEXP name_, SEXP text_) {
@@ -40,26 +82,50 @@ SEXP publish_stream(SEXP name_, SEXP text_) {
     return R_NilValue;
 }
 
-SEXP display_data(SEXP js_data, SEXP js_metadata){
+// transient part of display messages: `display_id_` is NULL for none,
+// TRUE for a new id, or the id to use
+std::string display_transient(SEXP display_id_, nl::json& transient) {
+    std::string id;
+    if (TYPEOF(display_id_) == STRSXP && XLENGTH(display_id_) == 1) {
+        id = CHAR(STRING_ELT(display_id_, 0));
+    } else if (TYPEOF(display_id_) == LGLSXP && XLENGTH(display_id_) == 1 && LOGICAL_ELT(display_id_, 0) == TRUE) {
+        id = xeus::new_xguid();
+    }
+
+    if (!id.empty()) {
+        transient["display_id"] = id;
+    }
+    return id;
+}
+
+SEXP display_data(SEXP js_data, SEXP js_metadata, SEXP display_id_){
     auto data = nl::json::parse(CHAR(STRING_ELT(js_data, 0)));
     auto metadata = nl::json::parse(CHAR(STRING_ELT(js_metadata, 0)));
-    
+    auto transient = nl::json::object();
+    auto id = display_transient(display_id_, transient);
+
     xeus_r::get_interpreter()->display_data(
-        std::move(data), std::move(metadata), /* transient = */ nl::json::object()
+        std::move(data), std::move(metadata), std::move(transient)
     );
 
-    return R_NilValue;
+    return id.empty() ? R_NilValue : Rf_mkString(id.c_str());
 }
 
-SEXP update_display_data(SEXP js_data, SEXP js_metadata){
+SEXP update_display_data(SEXP js_data, SEXP js_metadata, SEXP display_id_){
+    if (TYPEOF(display_id_) != STRSXP) {
+        Rf_error("update_display_data() needs the id of the display to update");
+    }
+
     auto data = nl::json::parse(CHAR(STRING_ELT(js_data, 0)));
     auto metadata = nl::json::parse(CHAR(STRING_ELT(js_metadata, 0)));
-    
+    auto transient = nl::json::object();
+    auto id = display_transient(display_id_, transient);
+
     xeus_r::get_interpreter()->update_display_data(
-        std::move(data), std::move(metadata), /* transient = */ nl::json::object()
+        std::move(data), std::move(metadata), std::move(transient)
     );
 
-    return R_NilValue;
+    return Rf_mkString(id.c_str());
 }
 
 SEXP clear_output(SEXP wait_) {
@@ -71,21 +137,70 @@ SEXP clear_output(SEXP wait_) {
 SEXP is_complete_request(SEXP code_) {
     std::string code = CHAR(STRING_ELT(code_, 0));
     auto is_complete = xeus_r::get_interpreter()->is_complete_request(code);
-
-    SEXP out = PROTECT(Rf_mkString(is_complete.dump(4).c_str()));
-    Rf_classgets(out, Rf_mkString("json"));
-    UNPROTECT(1);
-    return out;
+    return to_r_json(is_complete);
 }
 
 SEXP xeusr_log(SEXP level_, SEXP msg_) {
-    std::string level = CHAR(STRING_ELT(level_, 0));
-    std::string msg = CHAR(STRING_ELT(msg_, 0));
-
-    // TODO: actually do some logging
+    int level = INTEGER_ELT(level_, 0);
+    if (level > xeus_r::log_level()) {
+        return R_NilValue;
+    }
+    xeus_r::log_message(level, Rf_translateCharUTF8(STRING_ELT(msg_, 0)));
     return R_NilValue;
 }
 
+SEXP xeusr_log_level(SEXP level_) {
+    int previous = xeus_r::log_level();
+    if (level_ != R_NilValue) {
+        xeus_r::set_log_level(Rf_asInteger(level_));
+    }
+    return Rf_ScalarInteger(previous);
+}
+
+// Comms that opted in to coalescing, by comm id. Superseded messages of
+// comms in batch mode wait in `comm_batches`, indexed by the msg_id of the
+// message that superseded them, until that one is delivered.
+enum class coalesce_mode { none, latest, batch };
+static std::map<std::string, coalesce_mode> comm_coalesce_modes;
+static std::map<std::string, std::vector<xeus::xmessage>> comm_batches;
+
+// Comms that accept re-entrant delivery of their messages while a cell
+// runs, by comm id. The external pointers are not protected here: the
+// entries are removed when they are finalized.
+static std::map<std::string, SEXP> comm_reentrant;
+
+// Drops the messages waiting in the batches of a comm
+void forget_batches(const std::string& comm_id) {
+    for (auto it = comm_batches.begin(); it != comm_batches.end(); ) {
+        if (!it->second.empty() && it->second.front().content().value("comm_id", "") == comm_id) {
+            it = comm_batches.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+// Forgets the coalescing and re-entrancy of a comm, and the messages
+// of its batches, when it is closed or finalized
+void forget_comm(const std::string& comm_id) {
+    comm_coalesce_modes.erase(comm_id);
+    comm_reentrant.erase(comm_id);
+    forget_batches(comm_id);
+}
+
+// closed by the frontend, when R has no close handler
+void on_close_forget(xeus::xcomm* comm) {
+    comm->on_close([id = comm->id()](xeus::xmessage) {
+        forget_comm(id);
+    });
+}
+
+void delete_comm(SEXP xp) {
+    auto comm = reinterpret_cast<xeus::xcomm*>(R_ExternalPtrAddr(xp));
+    forget_comm(comm->id());
+    delete comm;
+}
+
 SEXP CommManager__register_target(SEXP name_) {
     using namespace xeus_r;
 
@@ -94,28 +209,20 @@ SEXP CommManager__register_target(SEXP name_) {
     auto callback = [name](xeus::xcomm&& comm, xeus::xmessage request) {
         // comm
         auto ptr_comm = new xeus::xcomm(std::move(comm));
+        on_close_forget(ptr_comm);
         SEXP xp_comm = PROTECT(R_MakeExternalPtr(
             reinterpret_cast<void*>(ptr_comm), R_NilValue, R_NilValue
         ));
-        R_RegisterCFinalizerEx(xp_comm, [](SEXP xp) {
-            delete reinterpret_cast<xeus::xcomm*>(R_ExternalPtrAddr(xp));
-        }, FALSE);
+        R_RegisterCFinalizerEx(xp_comm, delete_comm, FALSE);
         SEXP r6_comm = PROTECT(r::new_hera_r6("Comm", xp_comm));
 
         // request
-        auto ptr_request = new xeus::xmessage(std::move(request));
-        SEXP xptr_request = PROTECT(R_MakeExternalPtr(
-            reinterpret_cast<void*>(ptr_request), R_NilValue, R_NilValue
-        ));
-        R_RegisterCFinalizerEx(xptr_request, [](SEXP xp) {
-            delete reinterpret_cast<xeus::xmessage*>(R_ExternalPtrAddr(xp));
-        }, FALSE);
-        SEXP r6_request = PROTECT(r::new_hera_r6("Message", xptr_request));
+        SEXP request_ = PROTECT(new_message(std::move(request)));
 
         // callback
-        r::invoke_hera_fn(".CommManager__register_target_callback", r6_comm, r6_request);
+        r::invoke_hera_fn(".CommManager__register_target_callback", r6_comm, request_);
 
-        UNPROTECT(4);
+        UNPROTECT(3);
     };
 
     get_interpreter()->comm_manager().register_comm_target(name, callback);
@@ -137,12 +244,11 @@ SEXP CommManager__new_comm(SEXP target_name_, SEXP s_description) {
 
     auto id = xeus::new_xguid();
     auto comm = new xeus::xcomm(target, id);
+    on_close_forget(comm);
     SEXP xp_comm = PROTECT(R_MakeExternalPtr(
         reinterpret_cast<void*>(comm), R_NilValue, R_NilValue
     ));
-    R_RegisterCFinalizerEx(xp_comm, [](SEXP xp) {
-        delete reinterpret_cast<xeus::xcomm*>(R_ExternalPtrAddr(xp));
-    }, FALSE);
+    R_RegisterCFinalizerEx(xp_comm, delete_comm, FALSE);
     SEXP r6_comm = PROTECT(r::new_hera_r6("Comm", xp_comm, s_description));
 
     UNPROTECT(2);
@@ -175,6 +281,7 @@ SEXP Comm__close(SEXP xp_comm, SEXP js_metadata, SEXP js_data) {
     auto data = nl::json::parse(CHAR(STRING_ELT(js_data, 0)));
     
     auto* comm = reinterpret_cast<xeus::xcomm*>(R_ExternalPtrAddr(xp_comm));
+    forget_comm(comm->id());
     comm->close(metadata, data, xeus::buffer_sequence());
     
     return R_NilValue;
@@ -190,40 +297,249 @@ SEXP Comm__send(SEXP xp_comm, SEXP js_metadata, SEXP js_data) {
     return R_NilValue;
 }
 
+// Streams the columns as Arrow IPC: the schema, one record batch of at
+// most `chunk_rows` rows per comm message, and the end of stream marker.
+// The fields of `js_data` are added to the data of every message.
+SEXP Comm__send_arrow(SEXP xp_comm, SEXP js_data, SEXP columns, SEXP nrow_, SEXP chunk_rows_) {
+    auto* comm = reinterpret_cast<xeus::xcomm*>(R_ExternalPtrAddr(xp_comm));
+    R_xlen_t nrow = static_cast<R_xlen_t>(Rf_asReal(nrow_));
+
+    // the record batches read `nrow` values of every column
+    for (R_xlen_t j = 0; j < XLENGTH(columns); j++) {
+        if (XLENGTH(VECTOR_ELT(columns, j)) != nrow) {
+            Rf_error("column %d has %lld values instead of %lld", static_cast<int>(j + 1),
+                static_cast<long long>(XLENGTH(VECTOR_ELT(columns, j))), static_cast<long long>(nrow));
+        }
+    }
+
+    R_xlen_t chunk_rows = std::max<R_xlen_t>(1, static_cast<R_xlen_t>(Rf_asReal(chunk_rows_)));
+
+    // the encoder throws, R errors must not skip the destructors
+    char error[256] = "";
+    double bytes = 0;
+    try {
+        auto data = nl::json::parse(CHAR(STRING_ELT(js_data, 0)));
+        data["method"] = "arrow";
+        data["nrow"] = nrow;
+
+        auto send = [&](const char* part, R_xlen_t offset, R_xlen_t length, xeus::buffer_sequence buffers) {
+            for (const auto& buffer: buffers) {
+                bytes += static_cast<double>(buffer.size());
+            }
+            data["part"] = part;
+            data["offset"] = offset;
+            data["length"] = length;
+            comm->send(nl::json::object(), data, std::move(buffers));
+        };
+
+        send("schema", 0, 0, { arrow_ipc::schema(columns) });
+        for (R_xlen_t offset = 0; offset < nrow; offset += chunk_rows) {
+            R_xlen_t length = std::min(chunk_rows, nrow - offset);
+            send("batch", offset, length, arrow_ipc::record_batch(columns, offset, length));
+        }
+        send("eos", nrow, 0, { arrow_ipc::eos() });
+    } catch (const std::exception& e) {
+        std::snprintf(error, sizeof(error), "%s", e.what());
+    }
+
+    if (error[0] != '\0') {
+        Rf_error("%s", error);
+    }
+    return Rf_ScalarReal(bytes);
+}
+
+// The calls to the R handlers are built once and kept alive by the
+// comm external pointer, in its protected slot, so that they live exactly
+// as long as the comm. The handler then only has to set the argument.
+SEXP comm_handler_call(SEXP xp_comm, R_xlen_t slot, SEXP handler) {
+    SEXP calls = R_ExternalPtrProtected(xp_comm);
+    if (calls == R_NilValue) {
+        calls = Rf_allocVector(VECSXP, 2);
+        R_SetExternalPtrProtected(xp_comm, calls);
+    }
+
+    SEXP call = r::r_call(handler, R_NilValue);
+    SET_VECTOR_ELT(calls, slot, call);
+    return call;
+}
+
 class Comm_Message_handler {
 public:
-    Comm_Message_handler(SEXP handler) : m_handler(handler){}
+    Comm_Message_handler(SEXP call, bool coalesce = false) : m_call(call), m_coalesce(coalesce){}
 
     inline void operator()(xeus::xmessage message) {
-        auto ptr_message = new xeus::xmessage(std::move(message));
-        SEXP xptr_message = PROTECT(R_MakeExternalPtr(
-            reinterpret_cast<void*>(ptr_message), R_NilValue, R_NilValue
-        ));
-        R_RegisterCFinalizerEx(xptr_message, [](SEXP xp) {
-            delete reinterpret_cast<xeus::xmessage*>(R_ExternalPtrAddr(xp));
-        }, FALSE);
-        
-        SEXP call = PROTECT(r::r_call(
-            m_handler, 
-            r::new_hera_r6("Message", xptr_message))
-        );
+        SEXP message_ = PROTECT(m_coalesce ? new_message_batch(std::move(message)) : new_message(std::move(message)));
+
+        SETCADR(m_call, message_);
+        Rf_eval(m_call, R_GlobalEnv);
+        SETCADR(m_call, R_NilValue);
 
-        Rf_eval(call, R_GlobalEnv);
+        // the handler may have assigned variables, or attached packages
+        get_symbol_index().invalidate();
 
-        UNPROTECT(2);
+        UNPROTECT(1);
     }
 
 private:
-    SEXP m_handler;
+
+    // comms in batch mode get a list of all the messages that
+    // were coalesced, followed by the message itself
+    static SEXP new_message_batch(xeus::xmessage&& message) {
+        const auto& comm_id = message.content().value("comm_id", "");
+        auto mode = comm_coalesce_modes.find(comm_id);
+        if (mode == comm_coalesce_modes.end() || mode->second != coalesce_mode::batch) {
+            return new_message(std::move(message));
+        }
+
+        std::vector<xeus::xmessage> batch;
+        auto pending = comm_batches.find(message.header().value("msg_id", ""));
+        if (pending != comm_batches.end()) {
+            batch = std::move(pending->second);
+            comm_batches.erase(pending);
+        }
+        batch.push_back(std::move(message));
+
+        auto n = batch.size();
+        SEXP out = PROTECT(Rf_allocVector(VECSXP, n));
+        for (decltype(n) i = 0; i < n; i++) {
+            SET_VECTOR_ELT(out, i, new_message(std::move(batch[i])));
+        }
+        UNPROTECT(1);
+        return out;
+    }
+
+    SEXP m_call;
+    bool m_coalesce;
 };
 
 SEXP Comm__on_close(SEXP xp_comm, SEXP handler) {
-    reinterpret_cast<xeus::xcomm*>(R_ExternalPtrAddr(xp_comm))->on_close(Comm_Message_handler(handler));
+    SEXP call = comm_handler_call(xp_comm, 1, handler);
+    auto comm = reinterpret_cast<xeus::xcomm*>(R_ExternalPtrAddr(xp_comm));
+    comm->on_close([id = comm->id(), handler = Comm_Message_handler(call)](xeus::xmessage message) mutable {
+        forget_comm(id);
+        handler(std::move(message));
+    });
     return R_NilValue;
 }
 
 SEXP Comm__on_message(SEXP xp_comm, SEXP handler) {
-    reinterpret_cast<xeus::xcomm*>(R_ExternalPtrAddr(xp_comm))->on_message(Comm_Message_handler(handler));
+    SEXP call = comm_handler_call(xp_comm, 0, handler);
+    reinterpret_cast<xeus::xcomm*>(R_ExternalPtrAddr(xp_comm))->on_message(Comm_Message_handler(call, /* coalesce = */ true));
+    return R_NilValue;
+}
+
+SEXP Comm__reentrant(SEXP xp_comm, SEXP enable_) {
+    auto comm = reinterpret_cast<xeus::xcomm*>(R_ExternalPtrAddr(xp_comm));
+
+    if (LOGICAL_ELT(enable_, 0) == TRUE) {
+        comm_reentrant[comm->id()] = xp_comm;
+    } else {
+        comm_reentrant.erase(comm->id());
+    }
+
+    return R_NilValue;
+}
+
+SEXP kernel_metrics() {
+    return to_r_json(metrics::snapshot());
+}
+
+SEXP metrics_add(SEXP name_, SEXP value_) {
+    metrics::add(CHAR(STRING_ELT(name_, 0)), Rf_asReal(value_));
+    return R_NilValue;
+}
+
+SEXP column_summaries(SEXP columns, SEXP bins_) {
+    return to_r_json(summarize_columns(columns, Rf_asInteger(bins_)));
+}
+
+SEXP complete_symbols(SEXP token_, SEXP limit_) {
+    int limit = std::max(0, Rf_asInteger(limit_));
+    auto names = get_symbol_index().complete(Rf_translateCharUTF8(STRING_ELT(token_, 0)), limit);
+
+    SEXP out = PROTECT(Rf_allocVector(STRSXP, names.size()));
+    for (std::size_t i = 0; i < names.size(); i++) {
+        SET_STRING_ELT(out, i, Rf_mkCharCE(names[i].c_str(), CE_UTF8));
+    }
+    UNPROTECT(1);
+    return out;
+}
+
+SEXP code_name(SEXP code_, SEXP cursor_) {
+    std::string code = CHAR(STRING_ELT(code_, 0));
+    const auto& parsed = get_parse_service().parse(code);
+    auto range = name_at(parsed, utf8_byte_offset(code, Rf_asInteger(cursor_)));
+    if (range.first == range.second) {
+        return R_NilValue;
+    }
+
+    SEXP out = PROTECT(Rf_allocVector(INTSXP, 2));
+    INTEGER(out)[0] = static_cast<int>(utf8_code_points(code, range.first));
+    INTEGER(out)[1] = static_cast<int>(utf8_code_points(code, range.second));
+    UNPROTECT(1);
+    return out;
+}
+
+SEXP code_string(SEXP code_, SEXP cursor_) {
+    std::string code = CHAR(STRING_ELT(code_, 0));
+    const auto& parsed = get_parse_service().parse(code);
+    auto start = string_at(parsed, utf8_byte_offset(code, Rf_asInteger(cursor_)));
+    if (start == std::string::npos) {
+        return R_NilValue;
+    }
+    return Rf_ScalarInteger(static_cast<int>(utf8_code_points(code, start)));
+}
+
+SEXP complete_path(SEXP text_, SEXP limit_) {
+    int limit = std::max(0, Rf_asInteger(limit_));
+    auto paths = get_path_index().complete(Rf_translateCharUTF8(STRING_ELT(text_, 0)), limit);
+
+    SEXP out = PROTECT(Rf_allocVector(STRSXP, paths.size()));
+    for (std::size_t i = 0; i < paths.size(); i++) {
+        SET_STRING_ELT(out, i, Rf_mkCharCE(paths[i].c_str(), CE_UTF8));
+    }
+    UNPROTECT(1);
+    return out;
+}
+
+SEXP code_call(SEXP code_, SEXP cursor_) {
+    std::string code = CHAR(STRING_ELT(code_, 0));
+    const auto& parsed = get_parse_service().parse(code);
+    call_context context;
+    if (!call_at(parsed, utf8_byte_offset(code, Rf_asInteger(cursor_)), context)) {
+        return R_NilValue;
+    }
+
+    const char* names[] = {"fun", "argument", ""};
+    SEXP out = PROTECT(Rf_mkNamed(VECSXP, names));
+    SET_VECTOR_ELT(out, 0, Rf_mkString(context.function.c_str()));
+    SET_VECTOR_ELT(out, 1, Rf_ScalarInteger(context.argument));
+    UNPROTECT(1);
+    return out;
+}
+
+SEXP process_events() {
+    xeus_r::process_shell_events(/* throttle = */ false);
+    return R_NilValue;
+}
+
+SEXP Comm__coalesce(SEXP xp_comm, SEXP mode_) {
+    auto comm = reinterpret_cast<xeus::xcomm*>(R_ExternalPtrAddr(xp_comm));
+    std::string mode = CHAR(STRING_ELT(mode_, 0));
+
+    if (mode == "latest") {
+        comm_coalesce_modes[comm->id()] = coalesce_mode::latest;
+    } else if (mode == "batch") {
+        comm_coalesce_modes[comm->id()] = coalesce_mode::batch;
+    } else {
+        comm_coalesce_modes.erase(comm->id());
+    }
+
+    // out of batch mode, the pending batches would never be delivered
+    if (mode != "batch") {
+        forget_batches(comm->id());
+    }
+
     return R_NilValue;
 }
 
@@ -247,6 +563,81 @@ SEXP Message__get_metadata(SEXP xptr_msg) {
     return to_r_json(ptr_msg->metadata());
 }
 
+// raw vectors backed by the buffers of an xeus::xmessage
+//
+// data1 is the external pointer to the message, so the message (and its
+// buffers) stays alive as long as one of the vectors is reachable from R,
+// data2 is the index of the buffer in the message. The buffers are read
+// only: when R asks for a writeable pointer, the buffer is copied to a
+// regular raw vector first, which then replaces the message in data1
+static R_altrep_class_t message_buffer_class;
+
+inline bool message_buffer_materialized(SEXP x) {
+    return TYPEOF(R_altrep_data1(x)) == RAWSXP;
+}
+
+inline const xeus::binary_buffer& message_buffer(SEXP x) {
+    auto ptr_msg = reinterpret_cast<xeus::xmessage*>(R_ExternalPtrAddr(R_altrep_data1(x)));
+    return ptr_msg->buffers()[INTEGER_ELT(R_altrep_data2(x), 0)];
+}
+
+R_xlen_t message_buffer_Length(SEXP x) {
+    return message_buffer_materialized(x) ? XLENGTH(R_altrep_data1(x)) : message_buffer(x).size();
+}
+
+void* message_buffer_Dataptr(SEXP x, Rboolean writeable) {
+    if (writeable && !message_buffer_materialized(x)) {
+        const auto& buffer = message_buffer(x);
+        SEXP copy = PROTECT(Rf_allocVector(RAWSXP, buffer.size()));
+        std::copy(buffer.begin(), buffer.end(), reinterpret_cast<char*>(RAW(copy)));
+        R_set_altrep_data1(x, copy);
+        UNPROTECT(1);
+    }
+    if (message_buffer_materialized(x)) {
+        return RAW(R_altrep_data1(x));
+    }
+    return const_cast<char*>(message_buffer(x).data());
+}
+
+const void* message_buffer_Dataptr_or_null(SEXP x) {
+    return message_buffer_materialized(x) ? RAW(R_altrep_data1(x)) : static_cast<const void*>(message_buffer(x).data());
+}
+
+Rbyte message_buffer_Elt(SEXP x, R_xlen_t i) {
+    return message_buffer_materialized(x) ? RAW(R_altrep_data1(x))[i] : static_cast<Rbyte>(message_buffer(x)[i]);
+}
+
+Rboolean message_buffer_Inspect(SEXP x, int /* pre */, int /* deep */, int /* pvec */, void (* /* inspect_subtree */)(SEXP, int, int, int)) {
+    Rprintf("xeus::xmessage buffer %d (len=%ld%s)\n", INTEGER_ELT(R_altrep_data2(x), 0), static_cast<long>(message_buffer_Length(x)),
+        message_buffer_materialized(x) ? ", materialized" : "");
+    return TRUE;
+}
+
+void init_message_buffer_class(DllInfo* info) {
+    message_buffer_class = R_make_altraw_class("message_buffer", "xeusr", info);
+
+    R_set_altrep_Length_method(message_buffer_class, message_buffer_Length);
+    R_set_altrep_Inspect_method(message_buffer_class, message_buffer_Inspect);
+    R_set_altvec_Dataptr_method(message_buffer_class, message_buffer_Dataptr);
+    R_set_altvec_Dataptr_or_null_method(message_buffer_class, message_buffer_Dataptr_or_null);
+    R_set_altraw_Elt_method(message_buffer_class, message_buffer_Elt);
+}
+
+SEXP Message__get_buffers(SEXP xptr_msg) {
+    auto ptr_msg = reinterpret_cast<xeus::xmessage*>(R_ExternalPtrAddr(xptr_msg));
+    auto n = ptr_msg->buffers().size();
+
+    SEXP out = PROTECT(Rf_allocVector(VECSXP, n));
+    for (decltype(n) i = 0; i < n; i++) {
+        SEXP index = PROTECT(Rf_ScalarInteger(i));
+        SET_VECTOR_ELT(out, i, R_new_altrep(message_buffer_class, xptr_msg, index));
+        UNPROTECT(1);
+    }
+
+    UNPROTECT(1);
+    return out;
+}
+
 }
 
 #ifdef __GNUC__
@@ -259,11 +650,25 @@ void register_r_routines() {
     static const R_CallMethodDef callMethods[]  = {
         {"xeusr_kernel_info_request"       , (DL_FUNC) &routines::kernel_info_request     , 0},
         {"xeusr_publish_stream"            , (DL_FUNC) &routines::publish_stream          , 2},
-        {"xeusr_display_data"              , (DL_FUNC) &routines::display_data            , 2},
-        {"xeusr_update_display_data"       , (DL_FUNC) &routines::update_display_data     , 2},
+        {"xeusr_display_data"              , (DL_FUNC) &routines::display_data            , 3},
+        {"xeusr_update_display_data"       , (DL_FUNC) &routines::update_display_data     , 3},
         {"xeusr_clear_output"              , (DL_FUNC) &routines::clear_output            , 1},
         {"xeusr_is_complete_request"       , (DL_FUNC) &routines::is_complete_request     , 1},
         {"xeusr_log"                       , (DL_FUNC) &routines::xeusr_log               , 2},
+        {"xeusr_log_level"                 , (DL_FUNC) &routines::xeusr_log_level         , 1},
+        {"xeusr_process_events"            , (DL_FUNC) &routines::process_events          , 0},
+        {"xeusr_format_window"             , (DL_FUNC) &routines::format_window           , 2},
+        {"xeusr_repr_size"                 , (DL_FUNC) &routines::repr_size               , 3},
+        {"xeusr_column_summaries"          , (DL_FUNC) &routines::column_summaries        , 2},
+        {"xeusr_kernel_metrics"            , (DL_FUNC) &routines::kernel_metrics          , 0},
+        {"xeusr_metrics_add"               , (DL_FUNC) &routines::metrics_add             , 2},
+        {"xeusr_repr_cacheable"            , (DL_FUNC) &routines::repr_cacheable          , 1},
+        {"xeusr_complete_symbols"          , (DL_FUNC) &routines::complete_symbols        , 2},
+        {"xeusr_code_name"                 , (DL_FUNC) &routines::code_name               , 2},
+        {"xeusr_code_call"                 , (DL_FUNC) &routines::code_call               , 2},
+        {"xeusr_code_string"               , (DL_FUNC) &routines::code_string             , 2},
+        {"xeusr_complete_path"             , (DL_FUNC) &routines::complete_path           , 2},
+        {"xeusr_lookup"                    , (DL_FUNC) &routines::lookup                  , 3},
         
         // CommManager
         {"CommManager__register_target"    , (DL_FUNC) &routines::CommManager__register_target, 1},
@@ -276,22 +681,116 @@ void register_r_routines() {
         {"Comm__open"                      , (DL_FUNC) &routines::Comm__open, 3},
         {"Comm__close"                     , (DL_FUNC) &routines::Comm__close, 3},
         {"Comm__send"                      , (DL_FUNC) &routines::Comm__send, 3},
+        {"Comm__send_arrow"                , (DL_FUNC) &routines::Comm__send_arrow, 5},
         {"Comm__on_close"                  , (DL_FUNC) &routines::Comm__on_close, 2},
         {"Comm__on_message"                , (DL_FUNC) &routines::Comm__on_message, 2},
+        {"Comm__coalesce"                  , (DL_FUNC) &routines::Comm__coalesce, 2},
+        {"Comm__reentrant"                 , (DL_FUNC) &routines::Comm__reentrant, 2},
+
+        // Progress
+        {"Progress__new"                   , (DL_FUNC) &routines::Progress__new, 3},
+        {"Progress__tick"                  , (DL_FUNC) &routines::Progress__tick, 2},
+        {"Progress__update"                , (DL_FUNC) &routines::Progress__update, 3},
+        {"Progress__done"                  , (DL_FUNC) &routines::Progress__done, 1},
 
         // Message aka xeus::xmessage
         {"Message__get_content"            , (DL_FUNC) &routines::Message__get_content, 1},
         {"Message__get_header"             , (DL_FUNC) &routines::Message__get_header, 1},
         {"Message__get_parent_header"      , (DL_FUNC) &routines::Message__get_parent_header, 1},
         {"Message__get_metadata"           , (DL_FUNC) &routines::Message__get_metadata, 1},
+        {"Message__get_buffers"            , (DL_FUNC) &routines::Message__get_buffers, 1},
 
         {NULL, NULL, 0}
     };
 
     R_registerRoutines(info, NULL, callMethods, NULL, NULL);
+
+    routines::init_message_buffer_class(info);
 }
 #ifdef __GNUC__
     #pragma GCC diagnostic pop
 #endif
 
+void coalesce_comm_messages(std::deque<xeus::xmessage>& queue) {
+    using namespace routines;
+
+    if (comm_coalesce_modes.empty()) {
+        return;
+    }
+
+    // walking backwards, a comm message is superseded when a later message
+    // on the same comm was seen, with no other kind of message in between:
+    // e.g. an execute request between two updates of a slider may depend
+    // on the first one.
+    std::map<std::string, std::string> latest; // comm id -> msg_id of the latest message
+    for (auto i = queue.size(); i-- > 0; ) {
+        const auto& message = queue[i];
+        if (message.header().value("msg_type", "") != "comm_msg") {
+            latest.clear();
+            continue;
+        }
+
+        auto comm_id = message.content().value("comm_id", "");
+        auto mode = comm_coalesce_modes.find(comm_id);
+        if (mode == comm_coalesce_modes.end()) {
+            continue;
+        }
+
+        auto superseding = latest.find(comm_id);
+        if (superseding == latest.end()) {
+            latest[comm_id] = message.header().value("msg_id", "");
+            continue;
+        }
+
+        if (mode->second == coalesce_mode::batch) {
+            // the superseded message may itself hold the batch of an earlier
+            // coalescing, e.g. by process_events() while a cell runs: it goes
+            // along, before it
+            std::vector<xeus::xmessage> moved;
+            auto own = comm_batches.find(message.header().value("msg_id", ""));
+            if (own != comm_batches.end()) {
+                moved = std::move(own->second);
+                comm_batches.erase(own);
+            }
+            moved.push_back(std::move(queue[i]));
+
+            auto& batch = comm_batches[superseding->second];
+            batch.insert(batch.begin(), std::make_move_iterator(moved.begin()), std::make_move_iterator(moved.end()));
+        }
+        queue.erase(queue.begin() + i);
+    }
+}
+
+bool dispatch_comm_message(xeus::xmessage& message) {
+    using namespace routines;
+
+    if (message.header().value("msg_type", "") != "comm_msg") {
+        return false;
+    }
+
+    auto comm = comm_reentrant.find(message.content().value("comm_id", ""));
+    if (comm == comm_reentrant.end()) {
+        return false;
+    }
+
+    SEXP calls = R_ExternalPtrProtected(comm->second);
+    if (calls == R_NilValue || VECTOR_ELT(calls, 0) == R_NilValue) {
+        return false;
+    }
+
+    // the handler runs in the middle of some other R code, so errors
+    // must not escape: they are reported and the cell carries on
+    struct data_t {
+        Comm_Message_handler handler;
+        xeus::xmessage message;
+    } data = { Comm_Message_handler(VECTOR_ELT(calls, 0), /* coalesce = */ true), std::move(message) };
+
+    R_ToplevelExec([](void* void_data) {
+        auto data = reinterpret_cast<data_t*>(void_data);
+        data->handler(std::move(data->message));
+    }, &data);
+
+    return true;
+}
+
 }
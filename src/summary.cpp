@@ -0,0 +1,368 @@
+/***************************************************************************
+* Copyright (c) 2023, QuantStack
+*
+* Distributed under the terms of the GNU General Public License v3.
+*
+* The full license is in the file LICENSE, distributed with this software.
+****************************************************************************/
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <numeric>
+#include <vector>
+
+#ifndef __EMSCRIPTEN__
+#include <thread>
+#endif
+
+#include "summary.hpp"
+
+namespace xeus_r {
+namespace routines {
+
+namespace {
+
+    uint64_t mix(uint64_t x) {
+        // splitmix64 finalizer
+        x ^= x >> 30; x *= 0xbf58476d1ce4e5b9ULL;
+        x ^= x >> 27; x *= 0x94d049bb133111ebULL;
+        x ^= x >> 31;
+        return x;
+    }
+
+    uint64_t hash_double(double x) {
+        if (x == 0) x = 0;   // -0 and 0 are the same value
+        uint64_t bits;
+        std::memcpy(&bits, &x, sizeof(bits));
+        return mix(bits);
+    }
+
+    // HyperLogLog with 2^12 registers, about 1.6% standard error
+    class hyperloglog {
+    public:
+
+        void add(uint64_t hash) {
+            uint64_t index = hash >> (64 - precision);
+            uint64_t rest = (hash << precision) | (uint64_t(1) << (precision - 1));
+            uint8_t rank = static_cast<uint8_t>(count_leading_zeros(rest) + 1);
+            m_registers[index] = std::max(m_registers[index], rank);
+        }
+
+        double estimate() const {
+            const double m = static_cast<double>(m_registers.size());
+            double sum = 0;
+            int zeros = 0;
+            for (auto r: m_registers) {
+                sum += std::ldexp(1.0, -r);
+                if (r == 0) zeros++;
+            }
+            double e = 0.7213 / (1 + 1.079 / m) * m * m / sum;
+
+            // small range correction: linear counting
+            if (e <= 2.5 * m && zeros > 0) {
+                e = m * std::log(m / zeros);
+            }
+            return std::round(e);
+        }
+
+    private:
+
+        static int count_leading_zeros(uint64_t x) {
+            int n = 0;
+            for (uint64_t bit = uint64_t(1) << 63; bit && !(x & bit); bit >>= 1) n++;
+            return n;
+        }
+
+        static constexpr int precision = 12;
+        std::array<uint8_t, 1 << precision> m_registers {};
+    };
+
+    // Histogram over a range that is not known in advance: the bins start
+    // around the first value and the range doubles, merging pairs of bins,
+    // whenever a value falls outside.
+    class histogram {
+    public:
+
+        explicit histogram(int bins)
+            : m_counts(std::max(2, bins / 2 * 2), 0)
+        {}
+
+        void add(double x) {
+            if (m_width == 0) {
+                m_low = x;
+                m_width = std::max(std::abs(x) * 1e-9, 1e-300) / m_counts.size();
+            }
+            while (x < m_low) grow_down();
+            while (x >= m_low + m_width * m_counts.size()) grow_up();
+
+            size_t bin = static_cast<size_t>((x - m_low) / m_width);
+            m_counts[std::min(bin, m_counts.size() - 1)]++;
+        }
+
+        nl::json to_json() const {
+            // the range is a power of 2 larger than needed, the
+            // empty bins at both ends are left out
+            size_t first = 0, last = m_counts.size();
+            while (first < last && m_counts[first] == 0) first++;
+            while (last > first && m_counts[last - 1] == 0) last--;
+
+            nl::json breaks = nl::json::array();
+            nl::json counts = nl::json::array();
+            for (size_t i = first; i < last; i++) {
+                breaks.push_back(m_low + m_width * i);
+                counts.push_back(m_counts[i]);
+            }
+            if (last > first) {
+                breaks.push_back(m_low + m_width * last);
+            }
+            return {{"breaks", breaks}, {"counts", counts}};
+        }
+
+    private:
+
+        void grow_up() {
+            size_t half = m_counts.size() / 2;
+            for (size_t i = 0; i < half; i++) {
+                m_counts[i] = m_counts[2 * i] + m_counts[2 * i + 1];
+            }
+            std::fill(m_counts.begin() + half, m_counts.end(), 0);
+            m_width *= 2;
+        }
+
+        void grow_down() {
+            size_t half = m_counts.size() / 2;
+            for (size_t i = half; i-- > 0;) {
+                m_counts[half + i] = m_counts[2 * i] + m_counts[2 * i + 1];
+            }
+            std::fill(m_counts.begin(), m_counts.begin() + half, 0);
+            m_low -= m_width * m_counts.size();
+            m_width *= 2;
+        }
+
+        std::vector<int64_t> m_counts;
+        double m_low = 0;
+        double m_width = 0;
+    };
+
+    enum class column_kind { logical, integer, factor, number, string, other };
+
+    // what a worker thread needs to know about a column: the pointers are
+    // taken on the main thread, no R API is used by the workers
+    struct column_data {
+        column_kind kind = column_kind::other;
+        R_xlen_t n = 0;
+        const int* ints = nullptr;
+        const double* doubles = nullptr;
+        const SEXP* strings = nullptr;
+        std::vector<const char*> levels;
+        nl::json result;
+    };
+
+    template <typename T, typename Missing>
+    void summarize_numbers(column_data& column, const T* data, Missing is_missing, int bins) {
+        hyperloglog distinct;
+        histogram hist(bins);
+        int64_t na = 0, finite = 0;
+        double min = R_PosInf, max = R_NegInf;
+        double mean = 0;
+
+        for (R_xlen_t i = 0; i < column.n; i++) {
+            T value = data[i];
+            if (is_missing(value)) {
+                na++;
+                continue;
+            }
+            double x = static_cast<double>(value);
+            distinct.add(hash_double(x));
+            if (!std::isfinite(x)) {
+                continue;
+            }
+            finite++;
+            min = std::min(min, x);
+            max = std::max(max, x);
+            // running mean does not overflow on large columns
+            mean += (x - mean) / static_cast<double>(finite);
+            hist.add(x);
+        }
+
+        column.result["na"] = na;
+        column.result["distinct"] = distinct.estimate();
+        if (finite > 0) {
+            column.result["min"] = min;
+            column.result["max"] = max;
+            column.result["mean"] = mean;
+            column.result["histogram"] = hist.to_json();
+        }
+    }
+
+    void summarize_logical(column_data& column) {
+        int64_t na = 0, n_true = 0, n_false = 0;
+        for (R_xlen_t i = 0; i < column.n; i++) {
+            int value = column.ints[i];
+            if (value == NA_LOGICAL) na++;
+            else if (value) n_true++;
+            else n_false++;
+        }
+
+        column.result["na"] = na;
+        column.result["distinct"] = (n_true > 0) + (n_false > 0);
+        if (n_true + n_false > 0) {
+            column.result["mean"] = static_cast<double>(n_true) / static_cast<double>(n_true + n_false);
+        }
+    }
+
+    void summarize_factor(column_data& column, int bins) {
+        std::vector<int64_t> counts(column.levels.size(), 0);
+        int64_t na = 0;
+        for (R_xlen_t i = 0; i < column.n; i++) {
+            int code = column.ints[i];
+            if (code == NA_INTEGER || code < 1 || static_cast<size_t>(code) > counts.size()) na++;
+            else counts[code - 1]++;
+        }
+
+        std::vector<size_t> order(counts.size());
+        std::iota(order.begin(), order.end(), 0);
+        size_t top = std::min(order.size(), static_cast<size_t>(bins));
+        std::partial_sort(order.begin(), order.begin() + top, order.end(), [&](size_t a, size_t b) {
+            return counts[a] > counts[b];
+        });
+
+        nl::json labels = nl::json::array();
+        nl::json top_counts = nl::json::array();
+        for (size_t k = 0; k < top && counts[order[k]] > 0; k++) {
+            labels.push_back(column.levels[order[k]]);
+            top_counts.push_back(counts[order[k]]);
+        }
+
+        column.result["na"] = na;
+        column.result["distinct"] = std::count_if(counts.begin(), counts.end(), [](int64_t c) { return c > 0; });
+        column.result["histogram"] = {{"labels", labels}, {"counts", top_counts}};
+    }
+
+    void summarize_strings(column_data& column) {
+        // strings are interned in the global CHARSXP cache: the same
+        // string is the same pointer, so hashing pointers is enough
+        hyperloglog distinct;
+        int64_t na = 0;
+        for (R_xlen_t i = 0; i < column.n; i++) {
+            SEXP s = column.strings[i];
+            if (s == NA_STRING) na++;
+            else distinct.add(mix(static_cast<uint64_t>(reinterpret_cast<uintptr_t>(s))));
+        }
+
+        column.result["na"] = na;
+        column.result["distinct"] = distinct.estimate();
+    }
+
+    void summarize(column_data& column, int bins) {
+        column.result["n"] = column.n;
+
+        switch (column.kind) {
+            case column_kind::logical:
+                summarize_logical(column);
+                break;
+            case column_kind::integer:
+                summarize_numbers(column, column.ints, [](int x) { return x == NA_INTEGER; }, bins);
+                break;
+            case column_kind::number:
+                summarize_numbers(column, column.doubles, [](double x) { return std::isnan(x); }, bins);
+                break;
+            case column_kind::factor:
+                summarize_factor(column, bins);
+                break;
+            case column_kind::string:
+                summarize_strings(column);
+                break;
+            case column_kind::other:
+                break;
+        }
+    }
+
+    column_data prepare(SEXP x) {
+        column_data column;
+        column.n = XLENGTH(x);
+
+        // the *_RO accessors may expand ALTREP vectors, which allocates,
+        // so this happens on the main thread
+        switch (TYPEOF(x)) {
+            case LGLSXP:
+                column.kind = column_kind::logical;
+                column.ints = LOGICAL_RO(x);
+                break;
+            case INTSXP:
+                column.ints = INTEGER_RO(x);
+                if (Rf_isFactor(x)) {
+                    column.kind = column_kind::factor;
+                    SEXP levels = Rf_getAttrib(x, R_LevelsSymbol);
+                    for (R_xlen_t i = 0; i < XLENGTH(levels); i++) {
+                        column.levels.push_back(Rf_translateCharUTF8(STRING_ELT(levels, i)));
+                    }
+                } else {
+                    column.kind = column_kind::integer;
+                }
+                break;
+            case REALSXP:
+                column.kind = column_kind::number;
+                column.doubles = REAL_RO(x);
+                break;
+            case STRSXP:
+                column.kind = column_kind::string;
+                column.strings = STRING_PTR_RO(x);
+                break;
+            default:
+                break;
+        }
+        return column;
+    }
+
+}
+
+nl::json summarize_columns(SEXP columns, int bins) {
+    R_xlen_t ncol = XLENGTH(columns);
+    std::vector<column_data> data;
+    data.reserve(ncol);
+    for (R_xlen_t j = 0; j < ncol; j++) {
+        data.push_back(prepare(VECTOR_ELT(columns, j)));
+    }
+
+    std::atomic<size_t> next(0);
+    auto work = [&]() {
+        for (size_t j = next++; j < data.size(); j = next++) {
+            summarize(data[j], bins);
+        }
+    };
+
+#ifdef __EMSCRIPTEN__
+    work();
+#else
+    // starting a thread costs more than summarizing a small frame, each
+    // thread gets at least `min_cells` values, small frames run inline
+    constexpr size_t min_cells = 1 << 18;
+    size_t cells = 0;
+    for (const auto& column: data) {
+        cells += static_cast<size_t>(column.n);
+    }
+    size_t n_threads = std::min<size_t>({data.size(), std::max(1u, std::thread::hardware_concurrency()), std::max<size_t>(1, cells / min_cells)});
+    std::vector<std::thread> threads;
+    for (size_t t = 1; t < n_threads; t++) {
+        threads.emplace_back(work);
+    }
+    work();
+    for (auto& thread: threads) {
+        thread.join();
+    }
+#endif
+
+    nl::json out = nl::json::array();
+    for (auto& column: data) {
+        out.push_back(std::move(column.result));
+    }
+    return out;
+}
+
+}
+}
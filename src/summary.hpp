@@ -0,0 +1,42 @@
+/***************************************************************************
+* Copyright (c) 2023, QuantStack
+*
+* Distributed under the terms of the GNU General Public License v3.
+*
+* The full license is in the file LICENSE, distributed with this software.
+****************************************************************************/
+
+#ifndef XEUS_R_SUMMARY_HPP
+#define XEUS_R_SUMMARY_HPP
+
+#define R_NO_REMAP
+
+#include "R.h"
+#include "Rinternals.h"
+
+#include "nlohmann/json.hpp"
+
+namespace nl = nlohmann;
+
+namespace xeus_r {
+namespace routines {
+
+// Summary statistics of the columns of a table, for the table header:
+// for each column of `columns` (logical, integer, factor, double or
+// character vectors) an object with
+//
+//   n, na        number of values and of missing values
+//   min, max     for numbers, null otherwise
+//   mean         for numbers, the proportion of TRUE for logicals
+//   distinct     estimated number of distinct values (HyperLogLog)
+//   histogram    {breaks, counts} for numbers, at most `bins` bins
+//                {labels, counts} of the most frequent levels of factors
+//
+// Each column is summarized in a single pass over its memory, the columns
+// are summarized in parallel.
+nl::json summarize_columns(SEXP columns, int bins);
+
+}
+}
+
+#endif
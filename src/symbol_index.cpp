@@ -0,0 +1,222 @@
+/***************************************************************************
+* Copyright (c) 2023, QuantStack
+*
+* Distributed under the terms of the GNU General Public License v3.
+*
+* The full license is in the file LICENSE, distributed with this software.
+****************************************************************************/
+
+#include <algorithm>
+#include <cctype>
+#include <iterator>
+#include <utility>
+
+#include "symbol_index.hpp"
+
+namespace xeus_r {
+
+namespace {
+
+    const char* reserved_words[] = {
+        "if", "else", "repeat", "while", "function", "for", "next", "break",
+        "TRUE", "FALSE", "NULL", "Inf", "NaN", "NA", "NA_integer_", "NA_real_",
+        "NA_character_", "NA_complex_"
+    };
+
+    bool starts_with(const std::string& s, const std::string& prefix) {
+        return s.compare(0, prefix.size(), prefix) == 0;
+    }
+
+    bool word_start(const std::string& s, std::size_t i) {
+        if (i == 0) return true;
+        char previous = s[i - 1];
+        return previous == '.' || previous == '_' ||
+            (std::islower(static_cast<unsigned char>(previous)) && std::isupper(static_cast<unsigned char>(s[i])));
+    }
+
+    // A name that can be typed as is: letters (any non-ASCII byte counts as
+    // one), digits, dots and underscores, starting with a letter or a dot
+    // not followed by a digit. `[.data.frame` or `%in%` are not.
+    bool is_syntactic(const std::string& name) {
+        auto letter = [](unsigned char c) { return std::isalpha(c) || c >= 0x80; };
+        if (name.empty()) return false;
+        unsigned char first = name[0];
+        if (!letter(first) && first != '.') return false;
+        if (first == '.' && name.size() > 1 && std::isdigit(static_cast<unsigned char>(name[1]))) return false;
+        return std::all_of(name.begin(), name.end(), [&letter](unsigned char c) {
+            return letter(c) || std::isdigit(c) || c == '.' || c == '_';
+        });
+    }
+
+    // Subsequence match of `token` in `name`, ignoring case: 0 when it does
+    // not match, otherwise higher for consecutive characters, characters at
+    // the start of words and shorter names.
+    int fuzzy_score(const std::string& name, const std::string& token) {
+        int score = 0;
+        std::size_t j = 0;
+        std::size_t last = std::string::npos;
+        for (std::size_t i = 0; i < name.size() && j < token.size(); i++) {
+            if (std::tolower(static_cast<unsigned char>(name[i])) != std::tolower(static_cast<unsigned char>(token[j]))) {
+                continue;
+            }
+            score += 10;
+            if (last != std::string::npos && last + 1 == i) score += 20;
+            if (word_start(name, i)) score += 30;
+            last = i;
+            j++;
+        }
+        if (j < token.size()) {
+            return 0;
+        }
+        return std::max(1, score * 4 - static_cast<int>(name.size()));
+    }
+
+    std::vector<std::string> list_names(SEXP env) {
+        SEXP names = PROTECT(R_lsInternal3(env, TRUE, FALSE));
+        std::vector<std::string> out;
+        out.reserve(XLENGTH(names));
+        for (R_xlen_t i = 0; i < XLENGTH(names); i++) {
+            out.emplace_back(Rf_translateCharUTF8(STRING_ELT(names, i)));
+        }
+        UNPROTECT(1);
+
+        std::sort(out.begin(), out.end());
+        return out;
+    }
+
+}
+
+void symbol_index::invalidate() {
+    m_dirty = true;
+}
+
+void symbol_index::update() {
+    // the search path is walked on each completion, environments that were
+    // attached or detached since are found even without invalidate()
+    std::vector<scope> scopes;
+    std::vector<std::string> added;
+    std::vector<std::string> removed;
+
+    if (m_names.empty()) {
+        added.assign(std::begin(reserved_words), std::end(reserved_words));
+    }
+
+    for (SEXP env = R_GlobalEnv; env != R_EmptyEnv; env = ENCLOS(env)) {
+        auto it = std::find_if(m_scopes.begin(), m_scopes.end(), [env](const scope& s) {
+            return s.env == env;
+        });
+
+        if (it != m_scopes.end() && (it->locked || !m_dirty)) {
+            scopes.push_back(std::move(*it));
+            it->env = nullptr;
+            continue;
+        }
+
+        std::vector<std::string> names = list_names(env);
+        if (it == m_scopes.end()) {
+            // the environment is kept alive while it is in the index, so that
+            // its address cannot be reused by a newly attached one
+            R_PreserveObject(env);
+            added.insert(added.end(), names.begin(), names.end());
+        } else {
+            // listed again: only the difference goes to the index
+            std::set_difference(names.begin(), names.end(), it->names.begin(), it->names.end(), std::back_inserter(added));
+            std::set_difference(it->names.begin(), it->names.end(), names.begin(), names.end(), std::back_inserter(removed));
+            it->env = nullptr;
+        }
+        bool locked = env != R_GlobalEnv && (env == R_BaseEnv || R_EnvironmentIsLocked(env));
+        scopes.push_back({env, locked, std::move(names)});
+    }
+
+    // detached
+    for (auto& s: m_scopes) {
+        if (s.env != nullptr) {
+            removed.insert(removed.end(), s.names.begin(), s.names.end());
+            R_ReleaseObject(s.env);
+        }
+    }
+
+    m_scopes = std::move(scopes);
+    m_dirty = false;
+
+    // a name is in the index while at least one environment has it. The
+    // removals go first, so that a name that moves from an environment
+    // to another stays in
+    std::vector<std::string> gone;
+    for (auto& name: removed) {
+        auto count = m_counts.find(name);
+        if (--count->second == 0) {
+            m_counts.erase(count);
+            gone.push_back(std::move(name));
+        }
+    }
+    std::vector<std::string> fresh;
+    for (auto& name: added) {
+        if (m_counts[name]++ == 0) {
+            fresh.push_back(std::move(name));
+        }
+    }
+
+    if (!gone.empty()) {
+        std::sort(gone.begin(), gone.end());
+        m_names.erase(std::remove_if(m_names.begin(), m_names.end(), [&gone](const std::string& name) {
+            return std::binary_search(gone.begin(), gone.end(), name);
+        }), m_names.end());
+    }
+    if (!fresh.empty()) {
+        std::sort(fresh.begin(), fresh.end());
+        auto middle = m_names.insert(m_names.end(), fresh.begin(), fresh.end());
+        std::inplace_merge(m_names.begin(), middle, m_names.end());
+    }
+}
+
+std::vector<std::string> symbol_index::complete(const std::string& token, std::size_t limit) {
+    update();
+
+    bool hidden = !token.empty() && token[0] == '.';
+    auto visible = [hidden](const std::string& name) {
+        return hidden || name.empty() || name[0] != '.';
+    };
+
+    std::vector<std::string> out;
+    auto first = std::lower_bound(m_names.begin(), m_names.end(), token);
+    auto last = first;
+    for (; last != m_names.end() && starts_with(*last, token); ++last) {
+        if (out.size() < limit && visible(*last)) {
+            out.push_back(*last);
+        }
+    }
+    if (out.size() >= limit || token.empty()) {
+        return out;
+    }
+
+    std::vector<std::pair<int, const std::string*>> fuzzy;
+    auto score_range = [&](auto begin, auto end) {
+        for (auto it = begin; it != end; ++it) {
+            // the fuzzy matches of a plain name are plain names too
+            if (!visible(*it) || !is_syntactic(*it)) continue;
+            int score = fuzzy_score(*it, token);
+            if (score > 0) {
+                fuzzy.emplace_back(-score, &*it);
+            }
+        }
+    };
+    score_range(m_names.cbegin(), std::vector<std::string>::const_iterator(first));
+    score_range(std::vector<std::string>::const_iterator(last), m_names.cend());
+
+    std::size_t n = std::min(fuzzy.size(), limit - out.size());
+    std::partial_sort(fuzzy.begin(), fuzzy.begin() + n, fuzzy.end(), [](const auto& a, const auto& b) {
+        return a.first < b.first || (a.first == b.first && *a.second < *b.second);
+    });
+    for (std::size_t i = 0; i < n; i++) {
+        out.push_back(*fuzzy[i].second);
+    }
+    return out;
+}
+
+symbol_index& get_symbol_index() {
+    static symbol_index index;
+    return index;
+}
+
+}
@@ -0,0 +1,64 @@
+/***************************************************************************
+* Copyright (c) 2023, QuantStack
+*
+* Distributed under the terms of the GNU General Public License v3.
+*
+* The full license is in the file LICENSE, distributed with this software.
+****************************************************************************/
+
+#ifndef XEUS_R_SYMBOL_INDEX_HPP
+#define XEUS_R_SYMBOL_INDEX_HPP
+
+#define R_NO_REMAP
+
+#include <cstddef>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "R.h"
+#include "Rinternals.h"
+
+namespace xeus_r {
+
+// Names of the search path, for completing symbols without walking the
+// search path with utils:::.completeToken() on each keystroke.
+//
+// The names of each environment of the search path are kept sorted.
+// Package environments are locked, so they are only listed when they get
+// attached. The global environment and the other unlocked environments are
+// listed again after invalidate(), i.e. after an execution or a comm message.
+// The search path is compared on each completion, and only the names that
+// were added or removed since are merged into the index.
+class symbol_index {
+public:
+
+    // Names starting with `token` in alphabetical order, followed by the
+    // syntactic names that contain the characters of `token` in order, best
+    // first.
+    // Names starting with a dot only match tokens starting with a dot.
+    std::vector<std::string> complete(const std::string& token, std::size_t limit);
+
+    void invalidate();
+
+private:
+
+    struct scope {
+        SEXP env;
+        bool locked;
+        std::vector<std::string> names;
+    };
+
+    void update();
+
+    std::vector<scope> m_scopes;
+    std::vector<std::string> m_names;    // sorted, unique
+    std::unordered_map<std::string, int> m_counts;    // environments with each name
+    bool m_dirty = true;
+};
+
+symbol_index& get_symbol_index();
+
+}
+
+#endif
@@ -0,0 +1,139 @@
+/***************************************************************************
+* Copyright (c) 2023, QuantStack
+*
+* Distributed under the terms of the GNU General Public License v3.
+*
+* The full license is in the file LICENSE, distributed with this software.
+****************************************************************************/
+
+#include <cmath>
+#include <cstdio>
+
+#include "table.hpp"
+
+namespace xeus_r {
+namespace routines {
+
+namespace {
+
+    // 7 significant digits, as getOption("digits") by default
+    SEXP format_double(double x) {
+        if (ISNA(x)) return NA_STRING;
+        if (std::isnan(x)) return Rf_mkChar("NaN");
+        if (std::isinf(x)) return Rf_mkChar(x > 0 ? "Inf" : "-Inf");
+
+        char buffer[32];
+        std::snprintf(buffer, sizeof(buffer), "%.7g", x);
+        return Rf_mkChar(buffer);
+    }
+
+    // days since 1970-01-01 to yyyy-mm-dd, from Howard Hinnant's civil_from_days()
+    SEXP format_date(double x) {
+        if (!std::isfinite(x)) return NA_STRING;
+
+        long z = static_cast<long>(std::floor(x)) + 719468;
+        long era = (z >= 0 ? z : z - 146096) / 146097;
+        long doe = z - era * 146097;
+        long yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+        long y = yoe + era * 400;
+        long doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+        long mp = (5 * doy + 2) / 153;
+        long d = doy - (153 * mp + 2) / 5 + 1;
+        long m = mp < 10 ? mp + 3 : mp - 9;
+        if (m <= 2) y++;
+
+        char buffer[32];
+        std::snprintf(buffer, sizeof(buffer), "%04ld-%02ld-%02ld", y, m, d);
+        return Rf_mkChar(buffer);
+    }
+
+    SEXP format_integer(int x) {
+        if (x == NA_INTEGER) return NA_STRING;
+
+        char buffer[16];
+        std::snprintf(buffer, sizeof(buffer), "%d", x);
+        return Rf_mkChar(buffer);
+    }
+
+    SEXP format_column(SEXP column, const int* rows, R_xlen_t n) {
+        SEXP out = PROTECT(Rf_allocVector(STRSXP, n));
+
+        switch (TYPEOF(column)) {
+            case LGLSXP: {
+                const int* data = LOGICAL_RO(column);
+                for (R_xlen_t i = 0; i < n; i++) {
+                    int value = data[rows[i] - 1];
+                    SET_STRING_ELT(out, i, value == NA_LOGICAL ? NA_STRING : Rf_mkChar(value ? "TRUE" : "FALSE"));
+                }
+                break;
+            }
+
+            case INTSXP: {
+                const int* data = INTEGER_RO(column);
+                if (Rf_isFactor(column)) {
+                    SEXP levels = Rf_getAttrib(column, R_LevelsSymbol);
+                    for (R_xlen_t i = 0; i < n; i++) {
+                        int value = data[rows[i] - 1];
+                        SET_STRING_ELT(out, i, value == NA_INTEGER ? NA_STRING : STRING_ELT(levels, value - 1));
+                    }
+                } else {
+                    for (R_xlen_t i = 0; i < n; i++) {
+                        SET_STRING_ELT(out, i, format_integer(data[rows[i] - 1]));
+                    }
+                }
+                break;
+            }
+
+            case REALSXP: {
+                const double* data = REAL_RO(column);
+                auto format = Rf_inherits(column, "Date") ? format_date : format_double;
+                for (R_xlen_t i = 0; i < n; i++) {
+                    SET_STRING_ELT(out, i, format(data[rows[i] - 1]));
+                }
+                break;
+            }
+
+            case STRSXP: {
+                const SEXP* data = STRING_PTR_RO(column);
+                for (R_xlen_t i = 0; i < n; i++) {
+                    SET_STRING_ELT(out, i, data[rows[i] - 1]);
+                }
+                break;
+            }
+
+            default:
+                Rf_error("cannot format a column of type %d natively", TYPEOF(column));
+        }
+
+        UNPROTECT(1);
+        return out;
+    }
+
+}
+
+SEXP format_window(SEXP columns, SEXP rows) {
+    const int* p_rows = INTEGER_RO(rows);
+    R_xlen_t n = XLENGTH(rows);
+    R_xlen_t ncol = XLENGTH(columns);
+
+    for (R_xlen_t j = 0; j < ncol; j++) {
+        R_xlen_t nrow = XLENGTH(VECTOR_ELT(columns, j));
+        for (R_xlen_t i = 0; i < n; i++) {
+            if (p_rows[i] < 1 || p_rows[i] > nrow) {
+                Rf_error("row index %d out of bounds", p_rows[i]);
+            }
+        }
+    }
+
+    SEXP out = PROTECT(Rf_allocVector(VECSXP, ncol));
+    for (R_xlen_t j = 0; j < ncol; j++) {
+        SET_VECTOR_ELT(out, j, format_column(VECTOR_ELT(columns, j), p_rows, n));
+    }
+    Rf_namesgets(out, Rf_getAttrib(columns, R_NamesSymbol));
+
+    UNPROTECT(1);
+    return out;
+}
+
+}
+}
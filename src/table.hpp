@@ -0,0 +1,30 @@
+/***************************************************************************
+* Copyright (c) 2023, QuantStack
+*
+* Distributed under the terms of the GNU General Public License v3.
+*
+* The full license is in the file LICENSE, distributed with this software.
+****************************************************************************/
+
+#ifndef XEUS_R_TABLE_HPP
+#define XEUS_R_TABLE_HPP
+
+#define R_NO_REMAP
+
+#include "R.h"
+#include "Rinternals.h"
+
+namespace xeus_r {
+namespace routines {
+
+// Formats the cells of a window of a table: `columns` is a list of
+// columns (logical, integer, factor, double, Date or character vectors)
+// and `rows` the 1-based indices of the rows to format, e.g. the visible
+// page of a sorted view. Returns a list of character vectors, with NA
+// for missing values.
+SEXP format_window(SEXP columns, SEXP rows);
+
+}
+}
+
+#endif
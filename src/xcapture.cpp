@@ -0,0 +1,267 @@
+/***************************************************************************
+* Copyright (c) 2023, QuantStack
+*
+* Distributed under the terms of the GNU General Public License v3.
+*
+* The full license is in the file LICENSE, distributed with this software.
+****************************************************************************/
+
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <mutex>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+#include "xeus-r/xcapture.hpp"
+
+namespace xeus_r
+{
+    namespace
+    {
+        const char capture_magic[8] = {'X', 'R', 'C', 'A', 'P', '\0', '\0', '\1'};
+
+        void put_le(std::vector<std::uint8_t>& out, std::uint64_t value, int bytes)
+        {
+            for (int i = 0; i < bytes; i++)
+            {
+                out.push_back(static_cast<std::uint8_t>(value >> (8 * i)));
+            }
+        }
+
+        std::uint64_t get_le(const unsigned char* in, int bytes)
+        {
+            std::uint64_t value = 0;
+            for (int i = 0; i < bytes; i++)
+            {
+                value |= static_cast<std::uint64_t>(in[i]) << (8 * i);
+            }
+            return value;
+        }
+
+        nl::json payload(const xeus::xmessage_base& message)
+        {
+            nl::json buffers = nl::json::array();
+            for (const auto& buffer : message.buffers())
+            {
+                buffers.push_back(nl::json::binary(std::vector<std::uint8_t>(buffer.begin(), buffer.end())));
+            }
+            return {
+                {"header", message.header()},
+                {"parent_header", message.parent_header()},
+                {"metadata", message.metadata()},
+                {"content", message.content()},
+                {"buffers", std::move(buffers)}
+            };
+        }
+
+        // Messages come from the shell thread, the control thread, and
+        // the R thread when publishing, hence the mutex. The file is
+        // flushed when the kernel goes idle, and when the kernel exits.
+        class capture_writer
+        {
+        public:
+
+            explicit capture_writer(const std::string& path)
+                : m_out(path, std::ios::binary)
+                , m_start(std::chrono::steady_clock::now())
+            {
+                if (!m_out)
+                {
+                    std::clog << "xr: could not open the capture file " << path << std::endl;
+                    return;
+                }
+                m_out.write(capture_magic, sizeof(capture_magic));
+            }
+
+            bool good() const
+            {
+                return m_out.good();
+            }
+
+            void record(capture_channel channel, const xeus::xmessage_base& message)
+            {
+                std::uint64_t time_ns = static_cast<std::uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::steady_clock::now() - m_start
+                ).count());
+
+                std::vector<std::uint8_t> cbor = nl::json::to_cbor(payload(message));
+                std::vector<std::uint8_t> head;
+                head.push_back(static_cast<std::uint8_t>(channel));
+                put_le(head, time_ns, 8);
+                put_le(head, cbor.size(), 4);
+
+                bool idle = channel == capture_channel::iopub
+                    && message.header().value("msg_type", "") == "status"
+                    && message.content().value("execution_state", "") == "idle";
+
+                std::lock_guard<std::mutex> lock(m_mutex);
+                m_out.write(reinterpret_cast<const char*>(head.data()), static_cast<std::streamsize>(head.size()));
+                m_out.write(reinterpret_cast<const char*>(cbor.data()), static_cast<std::streamsize>(cbor.size()));
+                if (idle)
+                {
+                    m_out.flush();
+                }
+            }
+
+        private:
+
+            std::mutex m_mutex;
+            std::ofstream m_out;
+            std::chrono::steady_clock::time_point m_start;
+        };
+
+        capture_writer* get_capture_writer()
+        {
+            static std::unique_ptr<capture_writer> writer = []() -> std::unique_ptr<capture_writer> {
+                const char* path = std::getenv("XEUS_R_CAPTURE");
+                if (path == nullptr || *path == '\0')
+                {
+                    return nullptr;
+                }
+                auto out = std::make_unique<capture_writer>(path);
+                return out->good() ? std::move(out) : nullptr;
+            }();
+            return writer.get();
+        }
+
+        class capturing_server final : public xeus::xserver
+        {
+        public:
+
+            explicit capturing_server(std::unique_ptr<xeus::xserver> server)
+                : p_server(std::move(server))
+            {
+                // the shell messages are captured by the shell runner
+                p_server->register_shell_listener([this](xeus::xmessage msg) {
+                    notify_shell_listener(std::move(msg));
+                });
+                p_server->register_control_listener([this](xeus::xmessage msg) {
+                    capture_message(capture_channel::control, msg);
+                    notify_control_listener(std::move(msg));
+                });
+                p_server->register_stdin_listener([this](xeus::xmessage msg) {
+                    capture_message(capture_channel::stdin_channel, msg);
+                    notify_stdin_listener(std::move(msg));
+                });
+                p_server->register_internal_listener([this](nl::json msg) {
+                    return notify_internal_listener(std::move(msg));
+                });
+            }
+
+        private:
+
+            void send_shell_impl(xeus::xmessage message) override
+            {
+                p_server->send_shell(std::move(message));
+            }
+
+            void send_control_impl(xeus::xmessage message) override
+            {
+                p_server->send_control(std::move(message));
+            }
+
+            void send_stdin_impl(xeus::xmessage message) override
+            {
+                p_server->send_stdin(std::move(message));
+            }
+
+            void publish_impl(xeus::xpub_message message, xeus::channel c) override
+            {
+                capture_message(capture_channel::iopub, message);
+                p_server->publish(std::move(message), c);
+            }
+
+            void start_impl(xeus::xpub_message message) override
+            {
+                p_server->start(std::move(message));
+            }
+
+            void abort_queue_impl(const listener& l, long polling_interval) override
+            {
+                p_server->abort_queue(l, polling_interval);
+            }
+
+            void stop_impl() override
+            {
+                p_server->stop();
+            }
+
+            void update_config_impl(xeus::xconfiguration& config) const override
+            {
+                p_server->update_config(config);
+            }
+
+            std::unique_ptr<xeus::xserver> p_server;
+        };
+    }
+
+    void capture_message(capture_channel channel, const xeus::xmessage_base& message)
+    {
+        if (auto* writer = get_capture_writer())
+        {
+            writer->record(channel, message);
+        }
+    }
+
+    bool capture_enabled()
+    {
+        return get_capture_writer() != nullptr;
+    }
+
+    std::unique_ptr<xeus::xserver> make_capturing_server(std::unique_ptr<xeus::xserver> server)
+    {
+        return std::make_unique<capturing_server>(std::move(server));
+    }
+
+    capture_reader::capture_reader(const std::string& path)
+        : m_in(path, std::ios::binary)
+    {
+        char magic[sizeof(capture_magic)];
+        if (!m_in.read(magic, sizeof(magic)) || std::memcmp(magic, capture_magic, sizeof(magic)) != 0)
+        {
+            throw std::runtime_error(path + " is not a xr capture");
+        }
+    }
+
+    bool capture_reader::next(captured_message& out)
+    {
+        unsigned char head[13];
+        if (!m_in.read(reinterpret_cast<char*>(head), sizeof(head)))
+        {
+            return false;
+        }
+
+        std::vector<std::uint8_t> cbor(static_cast<std::size_t>(get_le(head + 9, 4)));
+        if (!m_in.read(reinterpret_cast<char*>(cbor.data()), static_cast<std::streamsize>(cbor.size())))
+        {
+            // the kernel died while writing the last record
+            return false;
+        }
+
+        out.channel = static_cast<capture_channel>(head[0]);
+        out.time_ns = get_le(head + 1, 8);
+        out.message = nl::json::from_cbor(cbor);
+        return true;
+    }
+
+    xeus::xmessage to_xmessage(const nl::json& message)
+    {
+        xeus::buffer_sequence buffers;
+        for (const auto& buffer : message.at("buffers"))
+        {
+            const auto& bytes = buffer.get_binary();
+            buffers.emplace_back(bytes.begin(), bytes.end());
+        }
+        return xeus::xmessage(
+            {message.at("header").value("session", "")},
+            message.at("header"),
+            message.at("parent_header"),
+            message.at("metadata"),
+            message.at("content"),
+            std::move(buffers)
+        );
+    }
+}
@@ -6,7 +6,10 @@
 * The full license is in the file LICENSE, distributed with this software.
 ****************************************************************************/
 
+#include <set>
 #include <string>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 #include <iostream>
 
@@ -30,10 +33,15 @@
 
 #ifndef _WIN32
 #include "Rinterface.h"
+#include "R_ext/eventloop.h"
 #endif
 
+#include "metrics.hpp"
+#include "parse_service.hpp"
+#include "symbol_index.hpp"
 #include "rtools.hpp"
 #include <algorithm>
+#include <chrono>
 #include <cstddef>
 
 namespace xeus_r {
@@ -62,6 +70,143 @@ void capture_WriteConsoleEx(const char *buf, int buflen, int otype) {
     }
 }
 
+static shell_poller p_shell_poller;
+static bool executing = false;
+
+// msg_id of the queued complete and inspect requests that a later request of
+// the same session supersedes, they get an empty reply. is_complete requests
+// are not superseded: the frontend acts on each status, and it is cheap to get
+static std::set<std::string> superseded_requests;
+
+void supersede_introspection_requests(const std::deque<xeus::xmessage>& queue) {
+    std::set<std::pair<std::string, std::string>> later;    // session, msg_type
+    for (auto i = queue.size(); i-- > 0; ) {
+        const auto& header = queue[i].header();
+        auto msg_type = header.value("msg_type", "");
+        if (msg_type != "complete_request" && msg_type != "inspect_request") {
+            continue;
+        }
+        if (!later.insert({header.value("session", ""), msg_type}).second) {
+            superseded_requests.insert(header.value("msg_id", ""));
+        }
+    }
+}
+
+// id of the cell of the execute request being dispatched, as sent by
+// JupyterLab and Notebook 7 in the metadata of the request
+static std::string dispatched_cell_id;
+
+void set_dispatched_request(const xeus::xmessage& message) {
+    const auto& metadata = message.metadata();
+    dispatched_cell_id = message.header().value("msg_type", "") == "execute_request" && metadata.is_object()
+        ? metadata.value("cellId", "")
+        : "";
+}
+
+static bool take_superseded(const nl::json& parent_header) {
+    // requests made in-process, e.g. by the benchmarks, have no header
+    if (!parent_header.is_object()) {
+        return false;
+    }
+    auto it = superseded_requests.find(parent_header.value("msg_id", ""));
+    if (it == superseded_requests.end()) {
+        return false;
+    }
+    superseded_requests.erase(it);
+    metrics::add("shell.superseded_requests");
+    return true;
+}
+
+void set_shell_poller(shell_poller poller) {
+    p_shell_poller = std::move(poller);
+}
+
+void process_shell_events(bool throttle) {
+    static bool processing = false;
+    static auto last = std::chrono::steady_clock::time_point();
+
+    if (processing || !p_shell_poller) {
+        return;
+    }
+
+    auto now = std::chrono::steady_clock::now();
+    if (throttle && now - last < std::chrono::milliseconds(20)) {
+        return;
+    }
+
+    // handlers run by the poller are not allowed to poll themselves
+    processing = true;
+    p_shell_poller();
+    processing = false;
+
+    last = std::chrono::steady_clock::now();
+}
+
+#ifndef _WIN32
+static void (*previous_R_PolledEvents)(void) = nullptr;
+
+// R calls this regularly, e.g. in R_CheckUserInterrupt(), which is a safe
+// point to run R code. Comm messages are only pumped while executing a
+// cell, the rest of the time the shell runner dispatches them.
+void PolledEvents() {
+    if (previous_R_PolledEvents) {
+        previous_R_PolledEvents();
+    }
+    if (executing) {
+        process_shell_events(/* throttle = */ true);
+    }
+}
+#endif
+
+static bool is_later_loaded() {
+    static SEXP sym_later = Rf_install("later");
+    return Rf_findVarInFrame(R_NamespaceRegistry, sym_later) != R_UnboundValue;
+}
+
+std::vector<int> idle_file_descriptors() {
+    std::vector<int> fds;
+#ifndef _WIN32
+    for (InputHandler* handler = R_InputHandlers; handler != nullptr; handler = handler->next) {
+        // skip the handler for stdin, which is not used by the kernel
+        if (handler->fileDescriptor > 0) {
+            fds.push_back(handler->fileDescriptor);
+        }
+    }
+#endif
+    return fds;
+}
+
+int idle_timeout() {
+    if (is_later_loaded()) {
+        return 50;
+    }
+#ifndef _WIN32
+    for (InputHandler* handler = R_InputHandlers; handler != nullptr; handler = handler->next) {
+        if (handler->fileDescriptor > 0) {
+            return 50;
+        }
+    }
+#endif
+    return -1;
+}
+
+void run_idle_handlers() {
+    // this is called from the shell runner, outside of any R context,
+    // so errors from the handlers must not escape
+    R_ToplevelExec([](void*) {
+#ifndef _WIN32
+        R_runHandlers(R_InputHandlers, R_checkActivity(0, 1));
+#endif
+        if (is_later_loaded()) {
+            SEXP fn_run_now = PROTECT(r::r_call(Rf_install("::"), Rf_install("later"), Rf_install("run_now")));
+            SEXP timeout = PROTECT(Rf_ScalarReal(0));
+            SEXP call_run_now = PROTECT(r::r_call(fn_run_now, timeout));
+            Rf_eval(call_run_now, R_GlobalEnv);
+            UNPROTECT(3);
+        }
+    }, nullptr);
+}
+
 int ReadConsole(const char *prompt, unsigned char *buffer, int length, int /*addtohistory*/) {
     std::string res = xeus::blocking_input_request(prompt, false);
     
@@ -94,6 +239,9 @@ interpreter::interpreter(int argc, char* argv[])
     ptr_R_WriteConsole = nullptr;
     ptr_R_WriteConsoleEx = WriteConsoleEx;
     ptr_R_ReadConsole = ReadConsole;
+
+    previous_R_PolledEvents = R_PolledEvents;
+    R_PolledEvents = PolledEvents;
 #endif
 
     xeus::register_interpreter(this);
@@ -117,7 +265,17 @@ void interpreter::execute_request_impl(
     SEXP execution_counter_ = PROTECT(Rf_ScalarInteger(execution_count));
     SEXP silent_ = PROTECT(Rf_ScalarLogical(config.silent));
 
-    SEXP result = r::invoke_hera_fn("execute", code_, execution_counter_, silent_);
+    // without a cell id, e.g. from a console, a cell is known by its code
+    SEXP cell_ = PROTECT(Rf_mkString(dispatched_cell_id.empty() ? code.c_str() : dispatched_cell_id.c_str()));
+    dispatched_cell_id.clear();
+
+    executing = true;
+    SEXP result = r::invoke_hera_fn("execute", code_, execution_counter_, silent_, cell_);
+    executing = false;
+    UNPROTECT(1);
+
+    // the code may have assigned variables, or attached packages
+    get_symbol_index().invalidate();
 
     if (Rf_inherits(result, "error_reply")) {
         std::string evalue = CHAR(STRING_ELT(VECTOR_ELT(result, 0), 0));
@@ -143,7 +301,7 @@ void interpreter::execute_request_impl(
         SEXP metadata_ = VECTOR_ELT(result, 1);
         auto data = nl::json::parse(CHAR(STRING_ELT(data_, 0)));
         auto metadata = nl::json::parse(CHAR(STRING_ELT(metadata_, 0)));
-        publish_execution_result(execution_count, data, metadata);
+        publish_execution_result(execution_count, std::move(data), std::move(metadata));
     }
 
     UNPROTECT(3);
@@ -165,8 +323,8 @@ void interpreter::configure_impl()
     UNPROTECT(3);
 }
 
-nl::json interpreter::is_complete_request_impl(const std::string& code_)
-{
+// "complete", "incomplete" or "invalid", from the R parser
+static std::string parse_status(const std::string& code_) {
     // initially code holds the string, but then it is being
     // replaced by incomplete, invalid or complete either in the
     // body handler or the error handler
@@ -212,9 +370,65 @@ nl::json interpreter::is_complete_request_impl(const std::string& code_)
     );
 
     // eventually we just have to extract the string from code (which has been replaced)
-    auto result = xeus::create_is_complete_reply(CHAR(STRING_ELT(code, 0)), "");
+    std::string status = CHAR(STRING_ELT(code, 0));
     UNPROTECT(1);
-    return result;
+    return status;
+}
+
+// parse status of the top-level pieces of recent cells, by code
+static std::unordered_map<std::string, std::string> piece_statuses;
+
+static std::string piece_status(std::string piece) {
+    auto it = piece_statuses.find(piece);
+    if (it != piece_statuses.end()) {
+        return it->second;
+    }
+    if (piece_statuses.size() >= 4096) {
+        piece_statuses.clear();
+    }
+    std::string status = parse_status(piece);
+    piece_statuses.emplace(std::move(piece), status);
+    return status;
+}
+
+nl::json interpreter::is_complete_request_impl(const std::string& code_)
+{
+    // the tokens tell about mismatched brackets and unterminated strings,
+    // and the indentation, without parsing the whole cell again
+    auto& parsed = get_parse_service().parse(code_);
+    std::size_t open_brackets = 0;
+    std::string status = bracket_status(parsed, open_brackets);
+    if (status.empty()) {
+        status = parsed.status;
+    }
+    if (!status.empty()) {
+        parsed.status = status;
+        return xeus::create_is_complete_reply(status, status == "incomplete" ? std::string(2 * open_brackets, ' ') : "");
+    }
+
+    // Otherwise the R parser tells, one top-level piece of the cell at a
+    // time: the pieces before the edited one are unchanged and their status
+    // is known, only the edited piece and the ones after it are parsed.
+    // Once a piece is complete, R parses the rest of the cell on its own;
+    // an invalid piece makes the cell invalid.
+    std::vector<std::size_t> breaks = top_level_breaks(parsed);
+    breaks.push_back(code_.size());
+    std::size_t start = 0;
+    status = "complete";
+    for (std::size_t end: breaks) {
+        if (end <= start) {
+            continue;
+        }
+        status = piece_status(code_.substr(start, end - start));
+        if (status == "complete") {
+            start = end;
+        } else if (status == "invalid") {
+            break;
+        }
+    }
+
+    parsed.status = status;
+    return xeus::create_is_complete_reply(status, status == "incomplete" ? std::string(2 * open_brackets, ' ') : "");
 }
 
 nl::json json_from_character_vector(SEXP x) {
@@ -229,6 +443,10 @@ nl::json json_from_character_vector(SEXP x) {
 
 nl::json interpreter::complete_request_impl(const std::string& code, int cursor_pos)
 {
+    if (take_superseded(parent_header())) {
+        return xeus::create_complete_reply(nl::json::array(), cursor_pos, cursor_pos);
+    }
+
     SEXP code_ = PROTECT(Rf_mkString(code.c_str()));
     SEXP cursor_pos_ = PROTECT(Rf_ScalarInteger(cursor_pos));
 
@@ -246,21 +464,26 @@ nl::json interpreter::complete_request_impl(const std::string& code, int cursor_
     return reply;
 }
 
-nl::json interpreter::inspect_request_impl(const std::string& code, int cursor_pos, int /*detail_level*/)
+nl::json interpreter::inspect_request_impl(const std::string& code, int cursor_pos, int detail_level)
 {
+    if (take_superseded(parent_header())) {
+        return xeus::create_inspect_reply(false);
+    }
+
     SEXP code_ = PROTECT(Rf_mkString(code.c_str()));
     SEXP cursor_pos_ = PROTECT(Rf_ScalarInteger(cursor_pos));
+    SEXP detail_level_ = PROTECT(Rf_ScalarInteger(detail_level));
 
-    SEXP result = PROTECT(r::invoke_hera_fn("inspect", code_, cursor_pos_));
+    SEXP result = PROTECT(r::invoke_hera_fn("inspect", code_, cursor_pos_, detail_level_));
     bool found = LOGICAL_ELT(VECTOR_ELT(result, 0), 0);
     if (!found) {
-        UNPROTECT(3);
+        UNPROTECT(4);
         return xeus::create_inspect_reply(false);
     }
 
     auto data = nl::json::parse(CHAR(STRING_ELT(VECTOR_ELT(result, 1), 0)));
 
-    UNPROTECT(3); // result, code_, cursor_pos_
+    UNPROTECT(4); // result, detail_level_, cursor_pos_, code_
     return xeus::create_inspect_reply(found, data);
 }
 
@@ -0,0 +1,323 @@
+/***************************************************************************
+* Copyright (c) 2023, QuantStack
+*
+* Distributed under the terms of the GNU General Public License v3.
+*
+* The full license is in the file LICENSE, distributed with this software.
+****************************************************************************/
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+#ifndef __EMSCRIPTEN__
+#include <thread>
+#endif
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "xeus-r/xlog.hpp"
+
+namespace xeus_r
+{
+    namespace
+    {
+        const char* level_names[] = {"", "ERROR", "INFO", "DEBUG"};
+
+        const char* level_name(int level)
+        {
+            return level_names[std::clamp(level, 0, 3)];
+        }
+
+        int initial_level()
+        {
+            const char* env = std::getenv("XEUS_R_LOG_LEVEL");
+            if (env == nullptr)
+            {
+                return 0;
+            }
+            for (int level = 1; level <= 3; level++)
+            {
+                if (std::strcmp(env, level_names[level]) == 0)
+                {
+                    return level;
+                }
+            }
+            return std::atoi(env);
+        }
+
+        std::atomic<int> current_level(initial_level());
+
+        // Each record has a sequence number, odd while record `i` is being
+        // written, 2 * i + 2 once it is complete: the reader checks it before
+        // and after copying, like a seqlock, so writers never wait. A reader
+        // may copy a record while it is overwritten, so the fields are relaxed
+        // atomics, the text is copied a word at a time.
+        constexpr std::size_t capacity = 1024;
+        constexpr std::size_t max_text = 480;
+        constexpr std::size_t text_words = max_text / sizeof(std::uint64_t);
+
+        struct record
+        {
+            std::atomic<std::uint64_t> seq {0};
+            std::atomic<int> level {0};
+            std::atomic<std::int64_t> time_ms {0};
+            std::atomic<std::uint32_t> size {0};
+            std::atomic<std::uint64_t> text[text_words] = {};
+        };
+
+        struct record_copy
+        {
+            int level = 0;
+            std::int64_t time_ms = 0;
+            std::uint32_t size = 0;
+            char text[max_text] = {};
+        };
+
+        enum class read_status { ok, pending, overwritten };
+
+        record records[capacity];
+        std::atomic<std::uint64_t> next_record(0);
+
+        void push(int level, const std::string& message)
+        {
+            std::uint64_t i = next_record.fetch_add(1, std::memory_order_relaxed);
+            record& r = records[i % capacity];
+
+            r.seq.store(2 * i + 1, std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_release);
+
+            r.level.store(level, std::memory_order_relaxed);
+            r.time_ms.store(std::chrono::duration_cast<std::chrono::milliseconds>(
+                std::chrono::system_clock::now().time_since_epoch()
+            ).count(), std::memory_order_relaxed);
+
+            std::size_t size = std::min(message.size(), max_text);
+            r.size.store(static_cast<std::uint32_t>(size), std::memory_order_relaxed);
+            for (std::size_t w = 0; w * sizeof(std::uint64_t) < size; w++)
+            {
+                std::uint64_t word = 0;
+                std::size_t offset = w * sizeof(std::uint64_t);
+                std::memcpy(&word, message.data() + offset, std::min(sizeof(word), size - offset));
+                r.text[w].store(word, std::memory_order_relaxed);
+            }
+
+            r.seq.store(2 * i + 2, std::memory_order_release);
+        }
+
+        void copy_record(const record& r, record_copy& out)
+        {
+            out.level = r.level.load(std::memory_order_relaxed);
+            out.time_ms = r.time_ms.load(std::memory_order_relaxed);
+            out.size = std::min<std::uint32_t>(r.size.load(std::memory_order_relaxed), max_text);
+            for (std::size_t w = 0; w * sizeof(std::uint64_t) < out.size; w++)
+            {
+                std::uint64_t word = r.text[w].load(std::memory_order_relaxed);
+                std::memcpy(out.text + w * sizeof(std::uint64_t), &word, sizeof(word));
+            }
+        }
+
+        read_status read(std::uint64_t i, record_copy& out)
+        {
+            const record& r = records[i % capacity];
+            std::uint64_t before = r.seq.load(std::memory_order_acquire);
+            if (before < 2 * i + 2)
+            {
+                return read_status::pending;
+            }
+            if (before > 2 * i + 2)
+            {
+                return read_status::overwritten;
+            }
+
+            copy_record(r, out);
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+            return r.seq.load(std::memory_order_relaxed) == before ? read_status::ok : read_status::overwritten;
+        }
+
+        // The single reader of the ring buffer
+        class log_writer
+        {
+        public:
+
+            log_writer()
+            {
+                if (const char* path = std::getenv("JUPYTER_LOGFILE"))
+                {
+                    m_file.open(path, std::ios::app);
+                }
+#ifndef __EMSCRIPTEN__
+                m_thread = std::thread([this]() {
+                    while (!m_stop.load())
+                    {
+                        drain();
+                        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+                    }
+                });
+#endif
+            }
+
+            ~log_writer()
+            {
+#ifndef __EMSCRIPTEN__
+                m_stop.store(true);
+                m_thread.join();
+#endif
+                drain();
+            }
+
+            void drain()
+            {
+                std::uint64_t end = next_record.load(std::memory_order_acquire);
+                std::uint64_t dropped = 0;
+                if (end - m_cursor > capacity)
+                {
+                    dropped += end - capacity - m_cursor;
+                    m_cursor = end - capacity;
+                }
+
+                record_copy copy;
+                for (; m_cursor < end; m_cursor++)
+                {
+                    read_status status = read(m_cursor, copy);
+                    if (status == read_status::pending)
+                    {
+                        break;
+                    }
+                    if (status == read_status::overwritten)
+                    {
+                        dropped++;
+                        continue;
+                    }
+                    write(copy);
+                }
+
+                if (dropped > 0)
+                {
+                    out() << "[xr] " << dropped << " log records were dropped" << std::endl;
+                }
+                out().flush();
+            }
+
+        private:
+
+            std::ostream& out()
+            {
+                return m_file.is_open() ? static_cast<std::ostream&>(m_file) : std::clog;
+            }
+
+            void write(const record_copy& r)
+            {
+                std::time_t seconds = static_cast<std::time_t>(r.time_ms / 1000);
+                std::tm tm {};
+#ifdef _WIN32
+                localtime_s(&tm, &seconds);
+#else
+                localtime_r(&seconds, &tm);
+#endif
+                char time[32];
+                std::size_t n = std::strftime(time, sizeof(time), "%H:%M:%S", &tm);
+                std::snprintf(time + n, sizeof(time) - n, ".%03d", static_cast<int>(r.time_ms % 1000));
+
+                out() << "[xr " << time << "] " << level_name(r.level) << " ";
+                out().write(r.text, r.size) << '\n';
+            }
+
+            std::ofstream m_file;
+            std::uint64_t m_cursor = 0;
+#ifndef __EMSCRIPTEN__
+            std::atomic<bool> m_stop {false};
+            std::thread m_thread;
+#endif
+        };
+
+        log_writer& get_log_writer()
+        {
+            static log_writer writer;
+            return writer;
+        }
+
+        void write_fd(int fd, const char* data, std::size_t size)
+        {
+#ifdef _WIN32
+            _write(fd, data, static_cast<unsigned int>(size));
+#else
+            while (size > 0)
+            {
+                ssize_t n = ::write(fd, data, size);
+                if (n <= 0)
+                {
+                    return;
+                }
+                data += n;
+                size -= static_cast<std::size_t>(n);
+            }
+#endif
+        }
+    }
+
+    int log_level()
+    {
+        return current_level.load(std::memory_order_relaxed);
+    }
+
+    void set_log_level(int level)
+    {
+        current_level.store(level, std::memory_order_relaxed);
+    }
+
+    void log_message(int level, const std::string& message)
+    {
+        if (level <= 0 || level > log_level())
+        {
+            return;
+        }
+
+        push(level, message);
+
+        auto& writer = get_log_writer();
+#ifdef __EMSCRIPTEN__
+        writer.drain();
+#else
+        (void) writer;
+#endif
+    }
+
+    void dump_log(int fd)
+    {
+        std::uint64_t end = next_record.load(std::memory_order_acquire);
+        std::uint64_t begin = end > capacity ? end - capacity : 0;
+
+        const char header[] = "xr: last log records:\n";
+        write_fd(fd, header, sizeof(header) - 1);
+
+        // no allocation here: the records are written from the ring buffer,
+        // the ones being written are skipped
+        record_copy copy;
+        for (std::uint64_t i = begin; i < end; i++)
+        {
+            if (read(i, copy) != read_status::ok)
+            {
+                continue;
+            }
+            const char* name = level_name(copy.level);
+            write_fd(fd, name, std::strlen(name));
+            write_fd(fd, " ", 1);
+            write_fd(fd, copy.text, copy.size);
+            write_fd(fd, "\n", 1);
+        }
+    }
+}
@@ -0,0 +1,142 @@
+/***************************************************************************
+* Copyright (c) 2023, QuantStack
+*
+* Distributed under the terms of the GNU General Public License v3.
+*
+* The full license is in the file LICENSE, distributed with this software.
+****************************************************************************/
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#ifdef _WIN32
+#include <winsock2.h>
+#else
+#include <poll.h>
+#endif
+
+#include "zmq.h"
+
+#include "nlohmann/json.hpp"
+
+#include "xeus-r/xcapture.hpp"
+#include "xeus-r/xinterpreter.hpp"
+#include "xshell_runner.hpp"
+
+namespace nl = nlohmann;
+
+namespace xeus_r
+{
+    void shell_runner::run_impl()
+    {
+#ifdef _WIN32
+        std::vector<WSAPOLLFD> items(2);
+#else
+        std::vector<pollfd> items(2);
+#endif
+        items[0].fd = get_shell_fd();
+        items[0].events = POLLIN;
+        items[1].fd = get_shell_controller_fd();
+        items[1].events = POLLIN;
+
+        set_shell_poller([this]() { poll_reentrant_messages(); });
+
+        while (true)
+        {
+            // the zmq file descriptors are edge triggered: they only signal
+            // new activity, so the sockets have to be drained before polling.
+            // This also drains between two messages, so that what arrived
+            // while a handler was running can be coalesced
+            while (true)
+            {
+                read_pending_messages();
+                coalesce_comm_messages(m_pending);
+                supersede_introspection_requests(m_pending);
+                if (m_pending.empty())
+                {
+                    break;
+                }
+
+                xeus::xmessage msg = std::move(m_pending.front());
+                m_pending.pop_front();
+                set_dispatched_request(msg);
+                notify_shell_listener(std::move(msg));
+            }
+
+            if (!process_controller_messages())
+            {
+                set_shell_poller(nullptr);
+                break;
+            }
+
+            // Idle: also wait on the file descriptors of R's input handlers
+            // (e.g. the one `later` uses to signal that callbacks are due),
+            // and run them when they have activity or on timeout. Shell
+            // requests still wake the loop up right away.
+            items.resize(2);
+            for (int fd : idle_file_descriptors())
+            {
+                items.push_back({});
+                items.back().fd = fd;
+                items.back().events = POLLIN;
+            }
+
+#ifdef _WIN32
+            int ready = WSAPoll(items.data(), static_cast<ULONG>(items.size()), idle_timeout());
+#else
+            int ready = poll(items.data(), items.size(), idle_timeout());
+#endif
+            bool shell_activity = ready > 0 && (items[0].revents != 0 || items[1].revents != 0);
+            if (ready == 0 || (ready > 0 && !shell_activity))
+            {
+                run_idle_handlers();
+            }
+        }
+    }
+
+    void shell_runner::read_pending_messages()
+    {
+        while (auto msg = read_shell(ZMQ_DONTWAIT))
+        {
+            capture_message(capture_channel::shell, *msg);
+            m_pending.push_back(std::move(*msg));
+        }
+    }
+
+    void shell_runner::poll_reentrant_messages()
+    {
+        read_pending_messages();
+        coalesce_comm_messages(m_pending);
+        supersede_introspection_requests(m_pending);
+
+        for (auto it = m_pending.begin(); it != m_pending.end(); )
+        {
+            if (dispatch_comm_message(*it))
+            {
+                it = m_pending.erase(it);
+            }
+            else
+            {
+                ++it;
+            }
+        }
+    }
+
+    bool shell_runner::process_controller_messages()
+    {
+        while (auto msg = read_shell_controller(ZMQ_DONTWAIT))
+        {
+            std::string value = std::move(*msg);
+            if (value == "stop")
+            {
+                send_shell_controller(std::move(value));
+                return false;
+            }
+
+            nl::json reply = notify_internal_listener(nl::json::parse(value));
+            send_shell_controller(reply.dump());
+        }
+        return true;
+    }
+}
@@ -0,0 +1,52 @@
+/***************************************************************************
+* Copyright (c) 2023, QuantStack
+*
+* Distributed under the terms of the GNU General Public License v3.
+*
+* The full license is in the file LICENSE, distributed with this software.
+****************************************************************************/
+
+#ifndef XEUS_R_SHELL_RUNNER_HPP
+#define XEUS_R_SHELL_RUNNER_HPP
+
+#include <deque>
+
+#include "xeus/xmessage.hpp"
+#include "xeus-zmq/xshell_runner.hpp"
+
+namespace xeus_r
+{
+    // Shell event loop of the xr kernel.
+    //
+    // Unlike the default runner that dispatches messages one at a time as
+    // they are read, this drains everything that is available on the shell
+    // socket first, so that the queue of pending messages can be inspected
+    // before dispatching, e.g. to coalesce stale comm messages, or to answer
+    // the completion requests the frontend has already moved on from.
+    class shell_runner final : public xeus::xshell_runner
+    {
+    public:
+
+        shell_runner() = default;
+        ~shell_runner() override = default;
+
+    private:
+
+        void run_impl() override;
+
+        // reads the messages available on the shell socket without blocking
+        void read_pending_messages();
+
+        // returns false when the runner has been asked to stop
+        bool process_controller_messages();
+
+        // called while R is busy executing a cell: delivers the messages of
+        // the comms that accept re-entrant delivery and keeps the others
+        // queued, in order, until the cell is done
+        void poll_reentrant_messages();
+
+        std::deque<xeus::xmessage> m_pending;
+    };
+}
+
+#endif
@@ -0,0 +1,153 @@
+#############################################################################
+# Copyright (c) 2023, QuantStack
+#
+# Distributed under the terms of the GNU General Public License v3.
+#
+# The full license is in the file LICENSE, distributed with this software.
+#############################################################################
+
+# Comm throughput of the xr kernel.
+#
+# This is not collected by pytest, run it with:
+#
+#     python bench_comm.py [--messages 10000] [--rows 1000000]
+#
+# The frontend side opens a comm on a target registered by R, floods it with
+# comm_msg messages and then waits for the reply of an execute_request, which
+# the kernel only processes once all the comm messages have been handled.
+#
+# Then a data frame of numeric, integer and character columns is streamed
+# back to the frontend, once as Arrow IPC record batches in the comm buffers
+# and once as JSON in the comm data, and the throughput is reported in MB/s.
+
+import argparse
+import json
+import time
+import uuid
+
+from jupyter_client.manager import start_new_kernel
+
+SETUP_CODE = """
+bench_received <- 0L
+CommManager$register_comm_target("hera.bench", function(comm, request) {
+    comm$on_message(function(msg) {
+        bench_received <<- bench_received + 1L
+        msg$content$data$value
+    })
+})
+
+CommManager$register_comm_target("hera.bench.arrow", function(comm, request) {
+    comm$on_message(function(msg) {
+        n <- msg$content$data$rows
+        df <- data.frame(
+            x = runif(n), y = seq_len(n),
+            label = sample(c("alpha", "beta", "gamma"), n, replace = TRUE)
+        )
+        if (identical(msg$content$data$format, "arrow")) {
+            comm$send_arrow(df, chunk_rows = msg$content$data$chunk_rows)
+        } else {
+            comm$send(list(method = "json", data = df))
+        }
+    })
+})
+"""
+
+
+def execute(kc, code, timeout=60):
+    msg_id = kc.execute(code)
+    stdout = ""
+    while True:
+        msg = kc.get_iopub_msg(timeout=timeout)
+        if msg["parent_header"].get("msg_id") != msg_id:
+            continue
+        if msg["msg_type"] == "stream":
+            stdout += msg["content"]["text"]
+        if msg["msg_type"] == "status" and msg["content"]["execution_state"] == "idle":
+            break
+    kc.get_shell_msg(timeout=timeout)
+    return stdout
+
+
+def bench_comm_messages(kc, n):
+    comm_id = uuid.uuid4().hex
+    kc.shell_channel.send(kc.session.msg("comm_open", {
+        "comm_id": comm_id, "target_name": "hera.bench", "data": {}
+    }))
+
+    start = time.perf_counter()
+    for i in range(n):
+        kc.shell_channel.send(kc.session.msg("comm_msg", {
+            "comm_id": comm_id, "data": {"value": i}
+        }))
+    received = int(execute(kc, "cat(bench_received)"))
+    elapsed = time.perf_counter() - start
+
+    return {
+        "messages": n,
+        "received": received,
+        "seconds": elapsed,
+        "messages_per_second": received / elapsed
+    }
+
+
+def bench_data_frame(kc, rows, fmt, chunk_rows=65536):
+    comm_id = uuid.uuid4().hex
+    kc.shell_channel.send(kc.session.msg("comm_open", {
+        "comm_id": comm_id, "target_name": "hera.bench.arrow", "data": {}
+    }))
+
+    start = time.perf_counter()
+    kc.shell_channel.send(kc.session.msg("comm_msg", {
+        "comm_id": comm_id, "data": {"rows": rows, "format": fmt, "chunk_rows": chunk_rows}
+    }))
+
+    size = 0
+    messages = 0
+    while True:
+        msg = kc.get_iopub_msg(timeout=120)
+        if msg["msg_type"] != "comm_msg" or msg["content"]["comm_id"] != comm_id:
+            continue
+        messages += 1
+        data = msg["content"]["data"]
+        if fmt == "arrow":
+            size += sum(len(b) for b in msg["buffers"])
+            if data["part"] == "eos":
+                break
+        else:
+            size += len(json.dumps(data))
+            break
+    elapsed = time.perf_counter() - start
+
+    return {
+        "rows": rows,
+        "messages": messages,
+        "bytes": size,
+        "seconds": elapsed,
+        "mb_per_second": size / elapsed / 1e6,
+        "rows_per_second": rows / elapsed
+    }
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--messages", type=int, default=10000)
+    parser.add_argument("--rows", type=int, default=1000000)
+    parser.add_argument("--kernel", default="xr")
+    args = parser.parse_args()
+
+    km, kc = start_new_kernel(kernel_name=args.kernel)
+    try:
+        execute(kc, SETUP_CODE)
+        result = {
+            "comm_messages": bench_comm_messages(kc, args.messages),
+            "arrow": bench_data_frame(kc, args.rows, "arrow"),
+            "json": bench_data_frame(kc, args.rows, "json")
+        }
+        print(json.dumps(result, indent=2))
+    finally:
+        kc.stop_channels()
+        km.shutdown_kernel()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,98 @@
+#############################################################################
+# Copyright (c) 2023, QuantStack
+#
+# Distributed under the terms of the GNU General Public License v3.
+#
+# The full license is in the file LICENSE, distributed with this software.
+#############################################################################
+
+# Latency of shell requests while the idle R event loop is active.
+#
+# This is not collected by pytest, run it with:
+#
+#     python bench_idle_loop.py [--requests 200]
+#
+# Latencies are measured first on a quiet kernel, then while a `later`
+# callback reschedules itself every 10ms, i.e. while the shell runner keeps
+# servicing the R event loop between requests. Requires the later package.
+
+import argparse
+import json
+import statistics
+import time
+
+from jupyter_client.manager import start_new_kernel
+
+from bench_comm import execute
+
+LATER_LOOP_CODE = """
+idle_ticks <- 0L
+idle_tick <- function() {
+    idle_ticks <<- idle_ticks + 1L
+    later::later(idle_tick, 0.01)
+}
+idle_tick()
+"""
+
+
+def percentile(values, q):
+    values = sorted(values)
+    return values[min(len(values) - 1, int(q * len(values)))]
+
+
+def summarize(latencies):
+    ms = [x * 1000 for x in latencies]
+    return {
+        "n": len(ms),
+        "p50_ms": percentile(ms, 0.50),
+        "p99_ms": percentile(ms, 0.99),
+        "mean_ms": statistics.mean(ms)
+    }
+
+
+def bench_requests(kc, n):
+    kernel_info = []
+    for _ in range(n):
+        start = time.perf_counter()
+        kc.kernel_info(reply=True, timeout=10)
+        kernel_info.append(time.perf_counter() - start)
+
+    execute_latency = []
+    for _ in range(n):
+        start = time.perf_counter()
+        kc.execute_interactive("NULL", timeout=10, output_hook=lambda msg: None)
+        execute_latency.append(time.perf_counter() - start)
+
+    return {
+        "kernel_info": summarize(kernel_info),
+        "execute": summarize(execute_latency)
+    }
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--requests", type=int, default=200)
+    parser.add_argument("--kernel", default="xr")
+    args = parser.parse_args()
+
+    km, kc = start_new_kernel(kernel_name=args.kernel)
+    try:
+        result = {"quiet": bench_requests(kc, args.requests)}
+
+        execute(kc, LATER_LOOP_CODE)
+        start = time.perf_counter()
+        time.sleep(1)
+        result["idle_loop"] = bench_requests(kc, args.requests)
+
+        # the callbacks should keep running at ~100 per second in between
+        ticks = int(execute(kc, "cat(idle_ticks)"))
+        result["idle_loop"]["later_ticks_per_second"] = ticks / (time.perf_counter() - start)
+
+        print(json.dumps(result, indent=2))
+    finally:
+        kc.stop_channels()
+        km.shutdown_kernel()
+
+
+if __name__ == "__main__":
+    main()
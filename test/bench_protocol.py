@@ -0,0 +1,132 @@
+#############################################################################
+# Copyright (c) 2023, QuantStack
+#
+# Distributed under the terms of the GNU General Public License v3.
+#
+# The full license is in the file LICENSE, distributed with this software.
+#############################################################################
+
+# Round trip latency of the kernel protocol, over zmq on localhost.
+#
+# This is not collected by pytest, run it with:
+#
+#     python bench_protocol.py [--requests 200] [--baseline bench_protocol_baseline.json]
+#
+# Each request is timed from the moment it is sent until the kernel is idle
+# again and has replied: kernel_info, a trivial execute, a stream heavy and
+# a display heavy execute, a completion and a comm message echoed back by R.
+#
+# The results are compared with the baseline file: a p50 more than
+# --threshold times the baseline one (and at least --slack-ms slower) is
+# reported as a slowdown, and the exit status is 1. Baselines depend on the
+# machine, the first run records it, --update-baseline records it again.
+
+import argparse
+import json
+import os
+import sys
+import time
+import uuid
+
+from jupyter_client.manager import start_new_kernel
+
+from bench_comm import execute
+from bench_idle_loop import summarize
+
+ECHO_CODE = """
+CommManager$register_comm_target("hera.bench.echo", function(comm, request) {
+    comm$on_message(function(msg) comm$send(msg$content$data))
+})
+"""
+
+STREAM_CODE = "for (i in 1:1000) cat('line', i, '\\n')"
+DISPLAY_CODE = "for (i in 1:100) display_data(list('text/plain' = as.character(i)))"
+
+
+def timed(n, request):
+    latencies = []
+    for _ in range(n):
+        start = time.perf_counter()
+        request()
+        latencies.append(time.perf_counter() - start)
+    return summarize(latencies)
+
+
+def run_code(kc, code):
+    kc.execute_interactive(code, timeout=60, output_hook=lambda msg: None)
+
+
+def comm_echo(kc, comm_id):
+    kc.shell_channel.send(kc.session.msg("comm_msg", {
+        "comm_id": comm_id, "data": {"value": 1}
+    }))
+    while True:
+        msg = kc.get_iopub_msg(timeout=10)
+        if msg["msg_type"] == "comm_msg" and msg["content"]["comm_id"] == comm_id:
+            return
+
+
+def bench_protocol(kc, n):
+    execute(kc, ECHO_CODE)
+    comm_id = uuid.uuid4().hex
+    kc.shell_channel.send(kc.session.msg("comm_open", {
+        "comm_id": comm_id, "target_name": "hera.bench.echo", "data": {}
+    }))
+
+    return {
+        "kernel_info": timed(n, lambda: kc.kernel_info(reply=True, timeout=10)),
+        "execute": timed(n, lambda: run_code(kc, "NULL")),
+        "execute_stream": timed(max(1, n // 10), lambda: run_code(kc, STREAM_CODE)),
+        "execute_display": timed(max(1, n // 10), lambda: run_code(kc, DISPLAY_CODE)),
+        "complete": timed(n, lambda: kc.complete("rnor", reply=True, timeout=10)),
+        "comm_echo": timed(n, lambda: comm_echo(kc, comm_id))
+    }
+
+
+def slowdowns(result, baseline, threshold, slack_ms):
+    out = {}
+    for name, current in result.items():
+        base = baseline.get(name)
+        if base is None:
+            continue
+        if current["p50_ms"] > base["p50_ms"] * threshold and current["p50_ms"] - base["p50_ms"] > slack_ms:
+            out[name] = {
+                "baseline_p50_ms": base["p50_ms"],
+                "p50_ms": current["p50_ms"],
+                "ratio": current["p50_ms"] / base["p50_ms"]
+            }
+    return out
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    parser.add_argument("--requests", type=int, default=200)
+    parser.add_argument("--kernel", default="xr")
+    parser.add_argument("--baseline", default=os.path.join(os.path.dirname(__file__), "bench_protocol_baseline.json"))
+    parser.add_argument("--threshold", type=float, default=1.5)
+    parser.add_argument("--slack-ms", type=float, default=0.5)
+    parser.add_argument("--update-baseline", action="store_true")
+    args = parser.parse_args()
+
+    km, kc = start_new_kernel(kernel_name=args.kernel)
+    try:
+        result = bench_protocol(kc, args.requests)
+    finally:
+        kc.stop_channels()
+        km.shutdown_kernel()
+
+    report = {"latency": result}
+    if args.update_baseline or not os.path.exists(args.baseline):
+        with open(args.baseline, "w") as f:
+            json.dump(result, f, indent=2)
+        report["baseline"] = "recorded in " + args.baseline
+    else:
+        with open(args.baseline) as f:
+            report["slowdowns"] = slowdowns(result, json.load(f), args.threshold, args.slack_ms)
+
+    print(json.dumps(report, indent=2))
+    return 1 if report.get("slowdowns") else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -6,8 +6,12 @@
 # The full license is in the file LICENSE, distributed with this software.
 #############################################################################
 
+import os
 import tempfile
+import time
 import unittest
+import uuid
+import jupyter_client
 import jupyter_kernel_test
 
 class KernelTests(jupyter_kernel_test.KernelTests):
@@ -28,7 +32,8 @@ class KernelTests(jupyter_kernel_test.KernelTests):
     code_display_data = [
         {"code": "plot(0)", "mime": "image/png"}, 
         {"code": "ggplot2::ggplot(iris, ggplot2::aes(Sepal.Length, Sepal.Width)) + ggplot2::geom_point()", "mime": "image/png"}, 
-        {"code": "View(head(iris))", "mime": "text/html"}
+        {"code": "View(head(iris))", "mime": "text/html"},
+        {"code": "View(iris)", "mime": "application/vnd.hera.table.v1+json"}
     ]
     
     # code_page_something = "?cat"
@@ -36,9 +41,9 @@ class KernelTests(jupyter_kernel_test.KernelTests):
     code_generate_error = "stop('ouch')"
     code_inspect_sample = "print"
     
-    complete_code_samples = ["fun()", "1 + 2", "a %>% b", "a |> b()", "a |> b(c = 1)"]
-    incomplete_code_samples = ["fun(", "1 + "]
-    invalid_code_samples = ["fun())", "a |> b", "a |> b(_)", "a |> b(c(_))"]
+    complete_code_samples = ["fun()", "1 + 2", "a %>% b", "a |> b()", "a |> b(c = 1)", "x <- 1\nf <- function(a)\n  a + x"]
+    incomplete_code_samples = ["fun(", "1 + ", "x <- 1\nf <- function(a)\n"]
+    invalid_code_samples = ["fun())", "a |> b", "a |> b(_)", "a |> b(c(_))", "x <- 1\nif (x) 1\nelse 2"]
 
     def test_htmlwidget(self):
         self.flush_channels()
@@ -48,6 +53,289 @@ class KernelTests(jupyter_kernel_test.KernelTests):
         self.assertIn("<html>", data["text/html"][0])
         self.assertIn("<h1>hello</h1>", data["text/html"][0])
 
+    def test_htmlwidget_dependencies(self):
+        self.flush_channels()
+        self.execute_helper(code="reset_html_dependencies()")
+
+        def widget_html(code):
+            reply, output_msgs = self.execute_helper(code=code)
+            results = [msg for msg in output_msgs if msg['msg_type'] == 'execute_result']
+            return results[0]['content']['data']['text/html']
+
+        first = widget_html("DT::datatable(head(iris))")
+        second = widget_html("DT::datatable(head(mtcars))")
+        self.assertIn("<script>", first)
+        self.assertNotIn("<script>", second.replace("<script>if (window.HTMLWidgets)", ""))
+
+        # the cell that carried the dependencies runs again: they are sent again
+        again = widget_html("DT::datatable(head(iris))")
+        self.assertEqual(len(again), len(first))
+
+    def test_repr_budget(self):
+        self.flush_channels()
+        reply, output_msgs = self.execute_helper(code="as.list(seq_len(200000))")
+        results = [msg for msg in output_msgs if msg['msg_type'] == 'execute_result']
+        data = results[0]['content']['data']
+        self.assertIn("application/vnd.hera.repr.v1+json", data)
+        self.assertEqual(data["application/vnd.hera.repr.v1+json"]["preview"]["total"], 200000)
+
+    def test_repr_budget_classed(self):
+        self.flush_channels()
+        self.execute_helper(code="big <- data.frame(x = runif(2e5), y = runif(2e5))")
+        reply, output_msgs = self.execute_helper(code="ggplot2::ggplot(big, ggplot2::aes(x, y)) + ggplot2::geom_point()")
+        self.assertIn("image/png", output_msgs[0]['content']['data'])
+        reply, output_msgs = self.execute_helper(code="lm(y ~ x, big)")
+        results = [msg for msg in output_msgs if msg['msg_type'] == 'execute_result']
+        self.assertIn("Coefficients", results[0]['content']['data']['text/plain'])
+
+    def test_repr_preview_max(self):
+        self.flush_channels()
+        self.execute_helper(code="old_options <- options(jupyter.repr_preview_max = 1)")
+        try:
+            self.execute_helper(code="as.list(seq_len(200000))")
+            reply, output_msgs = self.execute_helper(code="as.list(seq_len(200001))")
+        finally:
+            self.execute_helper(code="options(old_options)")
+        closed = [msg for msg in output_msgs if msg['msg_type'] == 'comm_close']
+        self.assertEqual(len(closed), 1)
+
+    def test_table_summary(self):
+        self.flush_channels()
+        reply, output_msgs = self.execute_helper(code="data.frame(x = c(1, NA, 3), y = c('a', 'b', 'a'))")
+        results = [msg for msg in output_msgs if msg['msg_type'] == 'execute_result']
+        summary = results[0]['content']['data']["application/vnd.hera.table.summary.v1+json"]
+        self.assertEqual(summary[0]["na"], 1)
+        self.assertEqual(summary[0]["max"], 3)
+        self.assertEqual(summary[1]["distinct"], 2)
+
+    def test_table_viewer_max(self):
+        self.flush_channels()
+        code = "old_options <- options(jupyter.table_viewer_max = 2); for (i in 1:3) View(iris); length(CommManager$comms())"
+        try:
+            reply, output_msgs = self.execute_helper(code=code)
+        finally:
+            self.execute_helper(code="options(old_options)")
+        closed = [msg for msg in output_msgs if msg['msg_type'] == 'comm_close']
+        self.assertEqual(len(closed), 1)
+
+    def test_repr_cache(self):
+        self.flush_channels()
+        self.execute_helper(code="hits <- function() sum(unlist(kernel_metrics()['repr.cache_hits'])); before <- hits()")
+        self.execute_helper(code="seq_len(20000)")
+        self.execute_helper(code="seq_len(20000)")
+        reply, output_msgs = self.execute_helper(code="cat(hits() - before)")
+        self.assertEqual(output_msgs[0]['content']['text'], "1")
+
+    def test_update_display_data(self):
+        self.flush_channels()
+        code = "id <- display_data(list('text/plain' = 'a'), display_id = TRUE); update_display_data(list('text/plain' = 'b'), display_id = id)"
+        reply, output_msgs = self.execute_helper(code=code)
+        display, update = output_msgs[0], output_msgs[1]
+        self.assertEqual(display['msg_type'], 'display_data')
+        self.assertEqual(update['msg_type'], 'update_display_data')
+        self.assertTrue(display['content']['transient']['display_id'])
+        self.assertEqual(display['content']['transient'], update['content']['transient'])
+
+    def test_progress(self):
+        self.flush_channels()
+        code = "p <- progress(1e5); for (i in 1:1e5) p$tick(); p$done()"
+        reply, output_msgs = self.execute_helper(code=code)
+        self.assertEqual(output_msgs[0]['msg_type'], 'display_data')
+        updates = [msg for msg in output_msgs if msg['msg_type'] == 'update_display_data']
+        # throttled: a handful of updates, not one per tick
+        self.assertLess(len(updates), 100)
+        self.assertIn("100%", updates[-1]['content']['data']['text/plain'])
+
+    def test_complete_symbols(self):
+        self.flush_channels()
+        self.execute_helper(code="completion_target_value <- 1")
+        self.kc.complete("completion_targ")
+        reply = self.get_non_kernel_info_reply(timeout=10)
+        self.assertIn("completion_target_value", reply['content']['matches'])
+        self.kc.complete("ctv")
+        reply = self.get_non_kernel_info_reply(timeout=10)
+        self.assertIn("completion_target_value", reply['content']['matches'])
+
+    def test_complete_symbols_syntactic(self):
+        self.flush_channels()
+        self.kc.complete("dtfrm")
+        reply = self.get_non_kernel_info_reply(timeout=10)
+        self.assertIn("data.frame", reply['content']['matches'])
+        self.assertNotIn("[.data.frame", reply['content']['matches'])
+
+    def test_complete_symbols_removed(self):
+        self.flush_channels()
+        self.execute_helper(code="removed_target_value <- 1")
+        self.kc.complete("removed_targ")
+        reply = self.get_non_kernel_info_reply(timeout=10)
+        self.assertIn("removed_target_value", reply['content']['matches'])
+        self.execute_helper(code="rm(removed_target_value)")
+        self.kc.complete("removed_targ")
+        reply = self.get_non_kernel_info_reply(timeout=10)
+        self.assertNotIn("removed_target_value", reply['content']['matches'])
+
+    def test_complete_member_of_expression(self):
+        self.flush_channels()
+        self.execute_helper(code="completion_list <- list(list(alpha_member = 1))")
+        self.kc.complete("completion_list[[1]]$alpha")
+        reply = self.get_non_kernel_info_reply(timeout=10)
+        self.assertIn("completion_list[[1]]$alpha_member", reply['content']['matches'])
+
+        # calls are not run to complete their members
+        self.execute_helper(code="called <- FALSE; completion_call <- function() { called <<- TRUE; list(a = 1) }")
+        self.kc.complete("completion_call()$")
+        self.get_non_kernel_info_reply(timeout=10)
+        reply, output_msgs = self.execute_helper(code="cat(called)")
+        self.assertEqual(output_msgs[0]['content']['text'], "FALSE")
+
+    def test_complete_path(self):
+        self.flush_channels()
+        with tempfile.TemporaryDirectory() as d:
+            open(os.path.join(d, "data.csv"), "w").close()
+            os.mkdir(os.path.join(d, "dir"))
+            self.kc.complete(f'read.csv("{d}/d')
+            reply = self.get_non_kernel_info_reply(timeout=10)
+            self.assertEqual(set(reply['content']['matches']), {f"{d}/data.csv", f"{d}/dir/"})
+
+    def test_inspect_call(self):
+        self.flush_channels()
+        # the cursor is on the arguments, the function is inspected
+        self.kc.inspect("stats::rnorm(10, ", cursor_pos=17)
+        reply = self.get_non_kernel_info_reply(timeout=10)
+        self.assertTrue(reply['content']['found'])
+
+    def test_inspect_detail_level(self):
+        self.flush_channels()
+        self.kc.inspect("rnorm", cursor_pos=5, detail_level=0)
+        summary = self.get_non_kernel_info_reply(timeout=10)['content']['data']['text/plain']
+        self.assertIn("rnorm(n, mean = 0, sd = 1)", summary)
+        self.kc.inspect("rnorm", cursor_pos=5, detail_level=1)
+        full = self.get_non_kernel_info_reply(timeout=10)['content']['data']['text/plain']
+        self.assertGreater(len(full), len(summary))
+
+    def test_introspection_side_effects(self):
+        self.flush_channels()
+        self.execute_helper(code="calls <- 0; makeActiveBinding('ab', function() calls <<- calls + 1, globalenv()); l <- list(alpha = 1, beta = 2)")
+        self.kc.inspect("ab", cursor_pos=2)
+        self.get_non_kernel_info_reply(timeout=10)
+        self.kc.complete("l$al")
+        reply = self.get_non_kernel_info_reply(timeout=10)
+        self.assertEqual(reply['content']['matches'], ["l$alpha"])
+        reply, output_msgs = self.execute_helper(code="calls")
+        self.assertEqual(output_msgs[0]['content']['data']['text/plain'], "[1] 0")
+
+    def test_superseded_completion(self):
+        self.flush_channels()
+        # queued while the kernel is busy, only the last one is computed
+        self.kc.execute("Sys.sleep(1)")
+        ids = [self.kc.complete("rnor") for _ in range(3)]
+        replies = {}
+        while len(replies) < 3:
+            msg = self.kc.get_shell_msg(timeout=10)
+            if msg['msg_type'] == 'complete_reply':
+                replies[msg['parent_header']['msg_id']] = msg['content']['matches']
+        self.assertEqual(replies[ids[0]], [])
+        self.assertEqual(replies[ids[1]], [])
+        self.assertIn("rnorm", replies[ids[2]])
+
+    def test_comm_batch(self):
+        self.flush_channels()
+        self.execute_helper(code="""
+            batch_sizes <- integer()
+            CommManager$register_comm_target("test.batch", function(comm, request) {
+                comm$coalesce("batch")
+                comm$on_message(function(msgs) batch_sizes <<- c(batch_sizes, length(msgs)))
+            })
+            batch_done <- FALSE
+            CommManager$register_comm_target("test.batch.done", function(comm, request) {
+                comm$reentrant()
+                comm$on_message(function(msg) batch_done <<- TRUE)
+            })
+        """)
+        comm_id = uuid.uuid4().hex
+        done_id = uuid.uuid4().hex
+        for id, target in [(comm_id, "test.batch"), (done_id, "test.batch.done")]:
+            self.kc.shell_channel.send(self.kc.session.msg("comm_open", {
+                "comm_id": id, "target_name": target, "data": {}
+            }))
+        # the cell keeps the messages queued until the re-entrant one that
+        # follows them is dispatched by process_events(): the shell socket
+        # keeps them in order, so they have all been coalesced by then
+        msg_id = self.kc.execute("while (!batch_done) { process_events(); Sys.sleep(0.05) }")
+        send = lambda id, i: self.kc.shell_channel.send(self.kc.session.msg("comm_msg", {
+            "comm_id": id, "data": {"value": i}
+        }))
+        for i in range(1, 5):
+            send(comm_id, i)
+        send(done_id, 0)
+        while self.kc.get_shell_msg(timeout=10)['parent_header'].get('msg_id') != msg_id:
+            pass
+        reply, output_msgs = self.execute_helper(code="cat(sum(batch_sizes), length(batch_sizes))")
+        self.assertEqual(output_msgs[0]['content']['text'], "4 1")
+
+    def test_comm_buffers(self):
+        self.flush_channels()
+        self.execute_helper(code="""
+            received <- NULL
+            CommManager$register_comm_target("test.buffers", function(comm, request) {
+                comm$on_message(function(msg) {
+                    received <<- msg$buffers[[1]]
+                    changed <- msg$buffers[[1]]
+                    changed[1] <- charToRaw("X")
+                    received_changed <<- changed
+                })
+            })
+        """)
+        comm_id = uuid.uuid4().hex
+        self.kc.shell_channel.send(self.kc.session.msg("comm_open", {
+            "comm_id": comm_id, "target_name": "test.buffers", "data": {}
+        }))
+        msg = self.kc.session.msg("comm_msg", {"comm_id": comm_id, "data": {}})
+        self.kc.session.send(self.kc.shell_channel.socket, msg, buffers=[b"abc"])
+        reply, output_msgs = self.execute_helper(code="cat(rawToChar(received), rawToChar(received_changed))")
+        self.assertEqual(output_msgs[0]['content']['text'], "abc Xbc")
+
+    def test_is_complete_indent(self):
+        self.flush_channels()
+        self.kc.is_complete("f(function(x) {\n")
+        reply = self.get_non_kernel_info_reply(timeout=10)
+        self.assertEqual(reply['content']['status'], 'incomplete')
+        self.assertEqual(reply['content']['indent'], '    ')
+
+    def test_log_level(self):
+        self.flush_channels()
+        reply, output_msgs = self.execute_helper(code="old <- log_level(3); hera:::log_debug('x = {1 + 1}'); log_level(old); c(log_level(), old)")
+        self.assertEqual(reply['content']['status'], 'ok')
+        self.assertEqual(output_msgs[0]['content']['data']['text/plain'], "[1] 0 0")
+
+class LogFileTests(unittest.TestCase):
+
+    @classmethod
+    def setUpClass(cls):
+        fd, cls.logfile = tempfile.mkstemp(suffix=".log")
+        os.close(fd)
+        env = dict(os.environ, JUPYTER_LOGFILE=cls.logfile)
+        cls.km, cls.kc = jupyter_client.manager.start_new_kernel(kernel_name="xr", env=env)
+
+    @classmethod
+    def tearDownClass(cls):
+        cls.kc.stop_channels()
+        cls.km.shutdown_kernel()
+        os.remove(cls.logfile)
+
+    def test_debug_record(self):
+        reply = self.kc.execute_interactive("old <- log_level(3); hera:::log_debug('log file {1 + 1}'); log_level(old)", timeout=30)
+        self.assertEqual(reply['content']['status'], 'ok')
+
+        # written by a background thread
+        content = ""
+        deadline = time.time() + 10
+        while "DEBUG log file 2" not in content and time.time() < deadline:
+            time.sleep(0.2)
+            with open(self.logfile) as f:
+                content = f.read()
+        self.assertIn("DEBUG log file 2", content)
+
 #########################################################################################
 #########################################################################################
 